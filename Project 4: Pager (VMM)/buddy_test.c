@@ -0,0 +1,195 @@
+// Split and merge test for the buddy allocator. Build and run with
+//   gcc -pthread -o buddy_test buddy_test.c && ./buddy_test
+// The shell is compiled in with its main renamed, so the test drives the
+// same buddy_allocate() and buddy_free() that hand out the pager's frames.
+#define main lope_shell_main
+#include "lopeShell.c"
+#undef main
+
+#define BUDDY_TEST_FRAMES 3000  // Not a power of two, so the free lists start with blocks of many orders
+#define BUDDY_TEST_ROUNDS 20000
+#define BUDDY_TEST_MAX_HELD 512
+
+// Structure recording which blocks the free lists hold
+typedef struct {
+    unsigned char order_at[BUDDY_TEST_FRAMES];  // Order + 1 of the free block starting at each frame, 0 if none
+    int free_blocks[BUDDY_ORDERS];
+    int free_frames;
+} FreeListSnapshot;
+
+int failures = 0;
+
+// Function to walk every free list, checking that each block is aligned,
+// marked as the head of a free block of its order and counted, and record
+// the blocks. Returns 0 if the lists are consistent.
+int snapshot_free_lists(FreeListSnapshot *snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+    int frames = 0;
+    for (int order = 0; order < BUDDY_ORDERS; order++) {
+        int count = 0;
+        int prev = -1;
+        for (int frame = buddy.free_lists[order]; frame != -1; frame = frame_table[frame].next_free) {
+            FrameTableEntry *head = &frame_table[frame];
+            if (frame % (1 << order) != 0 || frame + (1 << order) > num_frames || !head->free_head ||
+                head->free_order != order || head->prev_free != prev || snapshot->order_at[frame] != 0) {
+                printf("FAIL free list %d: block at frame %d is misplaced or linked wrongly\n", order, frame);
+                return -1;
+            }
+            snapshot->order_at[frame] = order + 1;
+            prev = frame;
+            count++;
+            frames += 1 << order;
+        }
+        if (count != buddy.free_blocks[order]) {
+            printf("FAIL free list %d: holds %d blocks but counts %d\n", order, count, buddy.free_blocks[order]);
+            return -1;
+        }
+        snapshot->free_blocks[order] = count;
+    }
+    if (frames != free_frame_count) {
+        printf("FAIL free lists hold %d frames but %d are counted free\n", frames, free_frame_count);
+        return -1;
+    }
+    snapshot->free_frames = frames;
+    return 0;
+}
+
+// Function to check that the free lists hold the same blocks as a snapshot
+void expect_free_lists(const char *name, const FreeListSnapshot *expected) {
+    FreeListSnapshot now;
+    if (snapshot_free_lists(&now) != 0) {
+        failures++;
+        return;
+    }
+    if (memcmp(&now, expected, sizeof(now)) != 0) {
+        printf("FAIL %s: the free lists did not return to their starting state\n", name);
+        for (int order = 0; order < BUDDY_ORDERS; order++) {
+            printf("  order %2d: %d blocks, expected %d\n", order, now.free_blocks[order], expected->free_blocks[order]);
+        }
+        failures++;
+        return;
+    }
+    printf("ok   %s\n", name);
+}
+
+// Function to check one expectation, counting a failure if it does not hold
+void expect(int condition, const char *name) {
+    if (!condition) {
+        printf("FAIL %s\n", name);
+        failures++;
+    }
+}
+
+int main() {
+    num_frames = BUDDY_TEST_FRAMES;
+    init_frame_table();
+    FreeListSnapshot start;
+    if (snapshot_free_lists(&start) != 0 || start.free_frames != num_frames) {
+        printf("FAIL the free lists do not cover all %d frames at startup\n", num_frames);
+        return 1;
+    }
+
+    // The smallest free block at startup is the 8 frames at the top, so a
+    // single frame splits it three times and leaves one block of orders 0-2
+    long splits = buddy.splits;
+    long merges = buddy.merges;
+    int frame = buddy_allocate(0);
+    expect(frame == BUDDY_TEST_FRAMES - 8, "single frame comes from the smallest free block");
+    expect(buddy.splits - splits == 3, "single frame splits its block three times");
+    expect(frame_table[frame].in_use && !frame_table[frame].free_head, "allocated frame is in use");
+    for (int order = 0; order < 3; order++) {
+        expect(buddy.free_blocks[order] == start.free_blocks[order] + 1, "split halves join their free lists");
+    }
+    buddy_free(frame, 0);
+    expect(buddy.merges - merges == 3, "freed frame merges back three times");
+    expect_free_lists("split and merge of a single frame", &start);
+
+    // Freeing two buddies in either order merges them into their parent
+    int low = buddy_allocate(0);
+    int high = buddy_allocate(0);
+    expect(high == (low ^ 1), "consecutive single frames are buddies");
+    buddy_free(low, 0);
+    expect(buddy.free_blocks[0] == start.free_blocks[0] + 1, "a frame whose buddy is in use does not merge");
+    buddy_free(high, 0);
+    expect_free_lists("buddies freed low then high", &start);
+    low = buddy_allocate(0);
+    high = buddy_allocate(0);
+    buddy_free(high, 0);
+    buddy_free(low, 0);
+    expect_free_lists("buddies freed high then low", &start);
+
+    // Frames 0-2047 are the only two blocks of the largest order, and a
+    // request that no block can satisfy fails without touching the lists
+    int blocks[2];
+    blocks[0] = buddy_allocate(BUDDY_ORDERS - 1);
+    blocks[1] = buddy_allocate(BUDDY_ORDERS - 1);
+    expect(blocks[0] != -1 && blocks[1] != -1, "both largest blocks can be allocated");
+    expect(buddy_allocate(BUDDY_ORDERS - 1) == -1, "a third largest block does not exist");
+    buddy_free(blocks[1], BUDDY_ORDERS - 1);
+    buddy_free(blocks[0], BUDDY_ORDERS - 1);
+    expect_free_lists("largest blocks", &start);
+
+    // Random allocations and frees, checking that no two blocks overlap,
+    // then free everything in a random order
+    static unsigned char owned[BUDDY_TEST_FRAMES];
+    int held_frame[BUDDY_TEST_MAX_HELD];
+    int held_order[BUDDY_TEST_MAX_HELD];
+    int held = 0;
+    uint32_t seed = 12345;
+    for (int round = 0; round < BUDDY_TEST_ROUNDS; round++) {
+        seed = seed * 1103515245u + 12345u;
+        int choice = seed >> 16;
+        if (held > 0 && (held == BUDDY_TEST_MAX_HELD || choice % 3 == 0)) {
+            int i = choice % held;
+            for (int j = 0; j < (1 << held_order[i]); j++) {
+                owned[held_frame[i] + j] = 0;
+            }
+            buddy_free(held_frame[i], held_order[i]);
+            held--;
+            held_frame[i] = held_frame[held];
+            held_order[i] = held_order[held];
+            continue;
+        }
+        int order = choice % 6;
+        int block = buddy_allocate(order);
+        if (block == -1) {
+            continue;
+        }
+        if (block % (1 << order) != 0) {
+            printf("FAIL block of order %d at frame %d is not aligned\n", order, block);
+            failures++;
+        }
+        for (int j = 0; j < (1 << order); j++) {
+            if (owned[block + j] || !frame_table[block + j].in_use) {
+                printf("FAIL frame %d was handed out twice\n", block + j);
+                failures++;
+                break;
+            }
+            owned[block + j] = 1;
+        }
+        held_frame[held] = block;
+        held_order[held] = order;
+        held++;
+    }
+    FreeListSnapshot during;
+    if (snapshot_free_lists(&during) != 0) {
+        failures++;
+    }
+    while (held > 0) {
+        seed = seed * 1103515245u + 12345u;
+        int i = (seed >> 16) % held;
+        buddy_free(held_frame[i], held_order[i]);
+        held--;
+        held_frame[i] = held_frame[held];
+        held_order[i] = held_order[held];
+    }
+    expect_free_lists("random allocations and frees", &start);
+    expect(free_frame_count == num_frames && used_frame_count == 0, "every frame is free again");
+
+    if (failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All buddy allocator checks passed\n");
+    return 0;
+}
@@ -6,64 +6,659 @@
 #include <sys/wait.h>
 #include <signal.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
 
 // Constants for memory management and limits
 #define MAX_INPUT_SIZE 1024
 #define MAX_ARG_COUNT 100
 #define MAX_HISTORY_COUNT 100
 #define PAGE_SIZE 4096  // Size of each virtual page in bytes
-#define PHYSICAL_MEMORY_SIZE (1 << 30)  // 1 GB of physical memory
-#define VIRTUAL_MEMORY_SIZE (1 << 32)  // 4 GB of virtual memory
-#define MAX_FRAMES (PHYSICAL_MEMORY_SIZE / PAGE_SIZE)
+#define DEFAULT_MEMORY_MB 1024  // Physical memory simulated unless -m says otherwise
+#define MAX_MEMORY_MB 16384
+#define VIRTUAL_MEMORY_SIZE (1ULL << 32)  // 4 GB of virtual memory
+#define VIRTUAL_PAGES ((int)(VIRTUAL_MEMORY_SIZE / PAGE_SIZE))
+#define PT_LEAF_BITS 9  // Each page table leaf maps 512 pages (2 MB)
+#define PT_LEAF_SIZE (1 << PT_LEAF_BITS)
 #define MAX_OPEN_FILES 256
+#define MAX_MAPPED_FILES 64  // Files mapped into the shell at once, executable images included
+#define MAX_FILE_REGIONS 16  // File-backed regions per process
+#define SWAP_FILE "lopeShell_swap.bin"
+#define SWAP_SIZE (1 << 30)  // 1 GB swap device shared by all processes
+#define SWAP_SLOTS (SWAP_SIZE / PAGE_SIZE)
+#define SWAP_MAP_WORDS (SWAP_SLOTS / 64)
+#define MAX_PROCESSES 100
+#define TLB_MAX_ENTRIES 4096
+#define TLB_DEFAULT_ENTRIES 64
+#define TLB_DEFAULT_WAYS 4
+#define CLEANER_INTERVAL_MS 100  // How often the cleaner checks the dirty frames
+#define CLEANER_DEFAULT_LOW 5  // Percent of frames that may stay dirty after a cleaning pass
+#define CLEANER_DEFAULT_HIGH 10  // Percent of frames dirty before the cleaner wakes up
+#define LATENCY_SUB_BITS 3
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS (LATENCY_SUB_BUCKETS * 40)
+#define READAHEAD_INITIAL_WINDOW 4  // Pages prefetched when a stream is first detected
+#define READAHEAD_MAX_WINDOW 64
+#define READAHEAD_TRIGGER 2  // Faults along the same stride before prefetching starts
+#define READAHEAD_MAX_STRIDE 64  // Larger jumps between faults are not treated as a stream
+#define AGING_MIN_INTERVAL 1024  // Minimum number of references between aging ticks
+#define MERGER_DEFAULT_PAGES 256  // Frames the merger scans per pass
+#define MERGER_DEFAULT_INTERVAL_MS 20  // Pause between merger passes
+#define MERGER_MAX_SHARING 256  // Most pages the merger collapses into one frame
+#define HUGE_PAGE_ORDER PT_LEAF_BITS  // A 2 MB huge page maps a whole page table leaf
+#define HUGE_PAGE_FRAMES (1 << HUGE_PAGE_ORDER)
+#define BUDDY_ORDERS 11  // Free lists for blocks of 1 to 1024 frames
+#define BUDDY_BENCH_DEFAULT_PERCENT 90  // Share of the free frames the buddy benchmark holds at most
+#define HUGE_FRAME_BLOCKS (num_frames / HUGE_PAGE_FRAMES)  // Aligned 2 MB blocks of physical memory
+#define TLB_HUGE_ENTRIES 32  // Fully associative TLB entries for huge pages
+#define ZSWAP_DEFAULT_MAX_PERCENT 20  // Pool budget as a percentage of physical memory
+#define ZSWAP_MAX_COMPRESSED (PAGE_SIZE * 3 / 4)  // Pages that compress worse bypass the pool
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+#define FAULT_MAX_WORKERS 64  // Most threads faulting pages in concurrently
+#define FRAME_CACHE_SIZE 32  // Free frames a fault worker takes from the buddy allocator at once
+#define FAULT_BATCH_SIZE 32  // Policy updates a fault worker queues before applying them
+#define FAULT_BATCH_HIT 0  // Kinds of queued policy update
+#define FAULT_BATCH_FAULT 1
+#define FAULT_BATCH_DIRTY_FAULT 2
+#define FAULT_BENCH_DEFAULT_PAGES 2048  // Pages each fault benchmark thread touches
+#define ACCESS_BATCH_SIZE 4096  // Accesses replay runs per acquisition of the pager lock
+#define LIVE_PROCESS_ID (MAX_PROCESSES - 1)  // Process whose pages back the live region
+#define LIVE_DEFAULT_PAGES 8192  // Pages of the live region, 32 MB
+#define LIVE_DEFAULT_PASSES 4  // Passes the live workload makes over the region
+#define WS_DEFAULT_WINDOW 65536  // References of its own that make up a process's working-set window
+#define WS_MIN_ESTIMATE_INTERVAL 4096  // Fewest references between working-set estimates
+#define WS_MIN_QUOTA 16  // Frames every process is entitled to, however small its working set
+#define OVERCOMMIT_HEURISTIC 0  // Overcommit modes, see overcommit_mode_names
+#define OVERCOMMIT_ALWAYS 1
+#define OVERCOMMIT_NEVER 2
+#define OVERCOMMIT_DEFAULT_RATIO 50  // Share of memory counted toward the commit limit in strict mode
+#define OOM_DEFAULT_MIN_PERCENT 2  // The OOM killer runs when the frames left to hand out fall below this share
+#define OOM_SCORE_ADJ_MIN -1000  // Adjustment of processes the OOM killer never chooses
+#define OOM_SCORE_ADJ_MAX 1000
+#define EVICTION_MAX_RETRIES 16  // Dirty victims that could not be saved before a fault gives up
+#define FAULT_TIERS 4  // Where a faulting page came from, see fault_tier_names
+#define FAULT_TIER_FILL 0
+#define FAULT_TIER_ZSWAP 1
+#define FAULT_TIER_SWAP 2
+#define FAULT_TIER_CACHE 3
+#define TRACE_OFF 0  // Levels of pager_trace_level
+#define TRACE_EVENTS 1
+#define TRACE_PAGES 2
+#define VMSTAT_DEFAULT_INTERVAL_MS 1000  // Interval between rows of the vmstat log
+
+// Key identifying a virtual page of a process, used by hash maps and ghost lists
+#define PAGE_KEY(process_id, page_number) (((uint64_t)(uint32_t)(process_id) << 32) | (uint32_t)(page_number))
+#define PAGE_KEY_PROCESS(key) ((int)((key) >> 32))
+#define PAGE_KEY_PAGE(key) ((int)((key) & 0xffffffffu))
 
 // Structure representing an entry in the page table
 typedef struct {
     int frame_number;  // The frame number in physical memory
     int valid;  // 1 if the page is valid, 0 otherwise
     int modified;  // 1 if the page has been modified, 0 otherwise
+    int swap_slot;  // Slot holding the page on the swap device, -1 if none
+    int zswap_entry;  // Entry holding the page in the compressed pool, -1 if none
 } PageTableEntry;
 
-// Structure representing a page table
+// Structure representing the bottom level of a page table
+typedef struct {
+    PageTableEntry entries[PT_LEAF_SIZE];  // Entries for PT_LEAF_SIZE consecutive pages
+    int live_entries;  // Entries in use; the leaf is freed when this drops to 0
+    int resident_entries;  // Entries mapping a frame
+    int huge_frame;  // First frame of the 2 MB block mapping the whole leaf, -1 if mapped page by page
+} PageTableLeaf;
+
+// Structure representing a two-level page table. The directory and the leaves
+// are allocated on first use, so memory grows with the pages actually mapped.
 typedef struct {
-    PageTableEntry *entries;  // Array of page table entries
-    int num_entries;  // Number of entries in the page table
+    PageTableLeaf **directory;  // Leaf for each PT_LEAF_SIZE pages, NULL if none mapped
+    int num_entries;  // Number of pages in the address space, 0 if the table is not set up
+    int num_leaves;  // Number of allocated leaves
+    int resident_pages;  // Pages mapping a frame, shared frames included
+    pthread_mutex_t lock;  // Serializes concurrent faults on the table
 } PageTable;
 
-// Structure representing an entry in the frame table
+// Page tables of all processes, indexed by process ID
+PageTable page_tables[MAX_PROCESSES];
+atomic_long page_table_bytes = 0;  // Memory used by all page tables
+
+// Structure representing an entry in the frame table. The flags and small
+// fields share two words. An all-zero entry is a free frame, so the table
+// needs no initialization and the buddy allocator sets up the remaining
+// fields when it hands the frame out.
 typedef struct {
-    int is_free;  // 1 if the frame is free, 0 if it is allocated
-    int process_id;  // ID of the process to which this frame is allocated
-    int page_number;  // Page number within the process's page table
+    signed int process_id : 8;  // ID of the process to which this frame is allocated
+    signed int page_number : 21;  // Page number within the process's page table
+    unsigned int in_use : 1;  // 1 if the frame is allocated, 0 if it is free
+    unsigned int free_head : 1;  // 1 if the frame heads a free block of free_order
+    unsigned int merged : 1;  // 1 if the merger collapsed identical pages into the frame
+    unsigned int map_count : 22;  // Page table entries mapping the frame; above 1 it is shared copy-on-write
+    unsigned int free_order : 4;  // Order of the free block the frame heads
+    unsigned int dirty_queued : 1;  // 1 if the frame is in the dirty queue
+    unsigned int writeback : 1;  // 1 while the cleaner is writing the frame to swap
+    unsigned int prefetched : 1;  // 1 if the page was read ahead and has not been referenced yet
+    unsigned int cached : 1;  // 1 if the page cache indexes the frame under the file page it holds
+    union {
+        struct {
+            int next_free;  // Neighbours in the free list of the block the frame heads, -1 at the ends
+            int prev_free;
+        };
+        struct {
+            int dirty_prev;  // Neighbours in the dirty queue, used only while the frame is allocated
+            int dirty_next;
+        };
+    };
+    int rmap_head;  // Sharers other than process_id/page_number, -1 if none
+    int owner_prev;  // Neighbours in the owning process's list of frames, -1 at the ends
+    int owner_next;
 } FrameTableEntry;
 
+_Static_assert(MAX_PROCESSES <= 128 && VIRTUAL_PAGES <= (1 << 20), "frame table fields too narrow");
+
+// Number of frames of physical memory, set with -m before the frame table is built
+int num_frames = DEFAULT_MEMORY_MB * (1024 / (PAGE_SIZE / 1024));
+
 // Global frame table
-FrameTableEntry frame_table[MAX_FRAMES];
+FrameTableEntry *frame_table;
+
+// Frames owned by each process, linked through the frame table, so that
+// walking a process's resident pages costs O(its frames). A shared frame is
+// in the list of the process holding its primary mapping.
+int process_frame_head[MAX_PROCESSES];
+int process_frame_count[MAX_PROCESSES];
+
+// Structure representing a further mapping of a shared frame in the reverse map
+typedef struct {
+    int process_id;
+    int page_number;
+    int next;  // Next sharer of the same frame, or next unused entry
+} RmapEntry;
+
+// Reverse-map entries for shared frames, grown on demand
+RmapEntry *rmap_entries = NULL;
+int rmap_capacity = 0;
+int rmap_free_head = -1;
+int shared_frame_count = 0;  // Frames mapped by more than one page
+long cow_copies = 0;  // Pages copied by write faults on shared frames
+
+// Physical memory arena: frame N holds its page's data at N * PAGE_SIZE
+char *physical_memory = NULL;
+int physical_memory_huge = 0;  // 1 if the arena is backed by explicit huge pages
+
+// Structure representing the binary buddy allocator that hands out frames.
+// A free block of order k is 2^k frames starting at a multiple of 2^k; its
+// first frame is linked into free_lists[k] through the frame table.
+typedef struct {
+    int free_lists[BUDDY_ORDERS];
+    int free_blocks[BUDDY_ORDERS];  // Length of each free list
+    int shell_frames;  // Frames allocated to the shell itself rather than to pages
+    long allocations;
+    long failures;  // Allocations with no free block large enough
+    long splits;
+    long merges;
+} BuddyAllocator;
+
+BuddyAllocator buddy;
+int free_frame_count = 0;
+int used_frame_count = 0;
+
+// Structure representing a doubly-linked list of frames, linked through lru_list
+typedef struct {
+    int head;  // Most recently inserted frame, -1 if the list is empty
+    int tail;  // Least recently inserted frame, -1 if the list is empty
+    int count;  // Number of frames in the list
+} FrameList;
 
 // Structure representing an entry in the LRU list for page replacement
 typedef struct {
-    int frame_number;  // The frame number
-    int last_used_time;  // The last time the frame was used
+    int prev;  // Neighbour towards the head of the list
+    int next;  // Neighbour towards the tail of the list
+    FrameList *list;  // List the frame is linked into, NULL if none
 } LRUEntry;
 
-// Global LRU list and current time for LRU replacement
-LRUEntry lru_list[MAX_FRAMES];
-int current_time = 0;
+// Links for the replacement lists. A frame is in at most one list at a time.
+LRUEntry *lru_list;
+
+// Global LRU list ordered from most recently used (head) to least recently used (tail)
+FrameList lru_frames = {-1, -1, 0};
+
+// Structure representing a page replacement policy. The pager reports every
+// fault, load, hit and removal; the policy picks a victim when memory is full.
+typedef struct {
+    const char *name;
+    void (*init)();  // Reset the policy's state
+    void (*on_fault)(int process_id, int page_number);  // A page fault is about to be serviced
+    int (*select_victim)();  // Choose a resident frame to evict
+    void (*on_load)(int frame_number);  // A page has been loaded into the frame
+    void (*on_access)(int frame_number);  // A resident page has been referenced
+    void (*on_remove)(int frame_number, int evicted);  // The frame is being evicted or freed
+    long hits;  // References to resident pages
+    long faults;  // References that caused a page fault
+    long evictions;  // Faults that had to replace a resident page
+} ReplacementPolicy;
+
+ReplacementPolicy *current_policy;  // Active policy, initialized with the policy table below
+long policy_clock = 0;  // Number of page references seen so far
+
+// Reference string used by the offline OPT policy: the position of the next
+// reference to the same page for every position in the string
+long *opt_next_use = NULL;
+long opt_length = 0;
+long opt_start = 0;  // Value of policy_clock at the first position of the string
+
+// Structure representing a hash map from page keys to values, using linear probing
+typedef struct {
+    uint64_t *keys;
+    long *values;
+    unsigned char *used;
+    size_t capacity;  // Always a power of two
+    size_t count;
+} PageMap;
+
+// Structure representing a file mapped into the shell's address space once
+// for every process that maps it: an executable image or the file of a
+// file-backed region
+typedef struct {
+    char path[256];
+    dev_t device;  // Device and inode identify the file whatever name it was opened by
+    ino_t inode;
+    char *data;
+    size_t size;
+    int users;  // Images and regions mapping the file, 0 if the slot is free
+    long cached_pages;  // Frames the page cache holds for the file
+} MappedFile;
+
+// Structure representing a region of a process's address space that maps a
+// file privately: reads share the page cache's frames, and the first write
+// to a page gives it a private copy
+typedef struct {
+    int first_page;
+    int pages;
+    int file;  // Index in mapped_files
+    int file_page;  // Page of the file mapped at first_page
+} FileRegion;
 
 // Structure representing the resources allocated to a process
 typedef struct {
     void **allocated_memory;  // Array of pointers to allocated memory blocks
     int num_allocated_blocks;  // Number of allocated memory blocks
+    int buffer_frame;  // First frame of the contiguous buffer holding the blocks
+    int buffer_order;  // Order of that buffer
     int open_files[MAX_OPEN_FILES];  // Array of open file descriptors
     int num_open_files;  // Number of open file descriptors
+    int executable_mapped;  // 1 once mapping the executable image has been attempted
+    char *executable_image;  // Mapped executable image, NULL if the process has none
+    size_t executable_size;  // Size of the mapped image in bytes
+    int executable_file;  // Index of the image in mapped_files, valid while executable_image is set
+    FileRegion regions[MAX_FILE_REGIONS];  // File-backed regions, which take precedence over the image
+    int num_regions;
 } ProcessResources;
 
 // Array to keep track of resources for multiple processes
-ProcessResources process_resources[100];
+ProcessResources process_resources[MAX_PROCESSES];
+MappedFile mapped_files[MAX_MAPPED_FILES];
+
+// Structure representing the page cache, which indexes the frames holding
+// file pages by file and page. A process faulting on a cached file page maps
+// the frame rather than reading the file again, so processes mapping the
+// same file share its frames. Cached frames are clean: evicting one drops it
+// without I/O. A page stays cached for as long as some process maps it.
+typedef struct {
+    int enabled;
+    PageMap index;  // Frame holding each cached page, keyed by PAGE_KEY(file, page)
+    long hits;  // Faults and prefetches served by mapping a cached frame
+    long misses;  // File pages read into a frame and added to the cache
+    long drops;  // Cached frames evicted or freed
+    long privatized;  // Cached frames written by their only mapper, which kept them as private copies
+    uint64_t *keys;  // Key each cached frame is indexed under, allocated on first use
+} PageCache;
+
+PageCache page_cache = {.enabled = 1};
+
+// Swap device shared by all processes, with a bitmap of used slots
+int swap_fd = -1;
+uint64_t swap_map[SWAP_MAP_WORDS];
+int swap_map_cursor = 0;  // Word where the last slot was found
+int swap_slots_used = 0;
+unsigned short swap_count[SWAP_SLOTS];  // Page table entries sharing each slot
+long swap_outs = 0;
+long swap_ins = 0;
+
+// Structure representing a page in the compressed pool
+typedef struct {
+    uint64_t key;  // Page the entry belongs to
+    unsigned char *data;  // Compressed page, NULL if the entry is unused
+    int size;  // Compressed size in bytes
+    int prev;  // Neighbours in the pool's LRU list; next also links unused entries
+    int next;
+} ZswapEntry;
+
+// Structure representing the compressed pool that sits between eviction and
+// the swap file. When the pool is over budget its oldest pages are written
+// back to swap.
+typedef struct {
+    ZswapEntry *entries;
+    int capacity;
+    int free_head;  // First unused entry, -1 if none
+    int lru_head;  // Most recently stored page
+    int lru_tail;  // Least recently stored page, written back first
+    int enabled;
+    int max_percent;  // Budget as a percentage of physical memory
+    long stored_pages;
+    long pool_bytes;  // Compressed bytes held by the pool
+    long stores;
+    long stored_bytes;  // Compressed bytes of all stores, for the average ratio
+    long rejects;  // Pages that compressed too poorly and went to swap
+    long loads;
+    long writebacks;
+    long invalidates;  // Copies dropped because the page was written
+} Zswap;
+
+Zswap zswap = {.free_head = -1, .lru_head = -1, .lru_tail = -1, .enabled = 1, .max_percent = ZSWAP_DEFAULT_MAX_PERCENT};
+
+// Pager lock. The shell, the simulator and the background threads take it
+// with lock_pager() before touching frames, page tables or the replacement
+// policy. Fault workers do not take it for ordinary faults; see FaultWorker.
+pthread_mutex_t pager_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Dirty frames, oldest first, for the background cleaner
+int dirty_queue_head = -1;
+int dirty_queue_tail = -1;
+int dirty_frame_count = 0;
+
+// Structure representing the background cleaner, which writes dirty frames to
+// swap ahead of eviction so that the fault handler normally finds clean victims
+typedef struct {
+    pthread_t thread;
+    int running;
+    int low_percent;  // Stop cleaning at this percentage of dirty frames
+    int high_percent;  // Start cleaning above this percentage of dirty frames
+    long pages_written;
+    long wakeups;
+} Cleaner;
+
+Cleaner cleaner = {.low_percent = CLEANER_DEFAULT_LOW, .high_percent = CLEANER_DEFAULT_HIGH};
+pthread_cond_t cleaner_wakeup = PTHREAD_COND_INITIALIZER;
+pthread_cond_t writeback_done = PTHREAD_COND_INITIALIZER;
+long clean_evictions = 0;
+long dirty_evictions = 0;
+
+// Structure representing the background merger, which finds frames with
+// identical contents and collapses their pages into one shared frame
+typedef struct {
+    pthread_t thread;
+    int running;
+    int pages_per_pass;
+    int interval_ms;
+    int cursor;  // Next frame to scan
+    PageMap hashes;  // Content hash -> frame, for stable frames seen in this scan
+    long frames_scanned;
+    long full_scans;
+    long pages_merged;
+    long scan_ns;  // Time spent scanning
+    double since;  // When the counters were last reset, in seconds
+} Merger;
+
+Merger merger = {.pages_per_pass = MERGER_DEFAULT_PAGES, .interval_ms = MERGER_DEFAULT_INTERVAL_MS};
+pthread_cond_t merger_wakeup = PTHREAD_COND_INITIALIZER;
+uint32_t *merge_checksums;  // Content hash of each frame when last scanned
+
+// Structure representing transparent huge page support. A page table leaf
+// whose pages sit in order in one aligned 2 MB block of frames is mapped as
+// a whole, so one fault and one TLB entry cover all of its pages.
+typedef struct {
+    int enabled;
+    long mapped;  // Leaves currently mapped as huge pages
+    long faults;  // Faults that mapped a whole huge page
+    long fallbacks;  // Huge page faults that found no free 2 MB block
+    long promotions;  // Fully populated leaves remapped as huge pages
+    long collapses;  // Promotions that copied the pages into a free 2 MB block
+    long demotions;  // Huge pages split back into 4 KB mappings
+} HugePages;
+
+HugePages huge_pages;
+
+// Structure representing the working set of a process: the pages it
+// referenced within its last window references (Denning's working set,
+// measured in the process's own virtual time). Only resident pages are
+// counted, a shared frame counting for the process that owns it.
+typedef struct {
+    long virtual_time;  // References the process has made
+    long faults;
+    long interval_references;  // References since the last estimate
+    long interval_faults;
+    double fault_rate;  // Faults per 1000 references in the last interval
+    int wss;  // Resident pages inside the window at the last estimate
+    int quota;  // Frames protected from other processes' faults, 0 before the first estimate
+    long lost_pages;  // Pages evicted while still inside the window
+    long interval_lost_pages;
+    int thrashing;  // 1 if the process lost pages of its working set in the last interval
+    int suspended;  // 1 while load control holds the process back
+    int suspended_wss;  // Working set when the process was suspended
+    long suspended_at;  // Estimate at which it was suspended
+} WorkingSet;
+
+WorkingSet working_sets[MAX_PROCESSES];
+long *frame_last_reference;  // Owner's virtual time at the frame's last reference
+
+// Structure representing working-set load control. Evictions prefer pages
+// that left their owner's working set, found by a clock hand sweeping the
+// frames (WSClock), so a process streaming through memory recycles its own
+// stale pages instead of taking the working sets of others. When every page
+// is inside a working set memory is overcommitted, and a process is suspended.
+typedef struct {
+    int enabled;
+    long window;  // Working-set window in references
+    long references;  // References since the last estimate
+    long estimates;
+    int hand;  // Frame where the working-set clock resumes
+    int saturated;  // 1 once a sweep found every page inside a working set, until the next estimate
+    long stale_evictions;  // Victims outside their owner's working set or of a suspended process
+    long quota_evictions;  // Victims whose owner held more than its quota
+    long fallback_evictions;  // Victims left to the replacement policy, every page being in a working set
+    long interval_fallbacks;
+    long suspensions;
+    long resumptions;
+    int suspended_processes;
+} LoadControl;
+
+LoadControl load_control = {0, WS_DEFAULT_WINDOW, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+// Structure representing commit accounting. A process reserves its pages
+// when it is created, and the overcommit mode decides how much may be
+// reserved: heuristic refuses only a single reservation larger than memory
+// and swap together, always never refuses, and never keeps the total under
+// swap plus ratio percent of memory, so that every reserved page has a home.
+typedef struct {
+    int mode;
+    int ratio;
+    long committed_pages;  // Pages reserved by all processes
+    long process_pages[MAX_PROCESSES];  // Pages reserved by each process
+    long refusals;
+} Overcommit;
+
+Overcommit overcommit = {OVERCOMMIT_HEURISTIC, OVERCOMMIT_DEFAULT_RATIO, 0, {0}, 0};
+const char *overcommit_mode_names[] = {"heuristic", "always", "never"};
+
+// Structure representing the OOM killer. When the frames the pager can still
+// hand out, free or evictable, fall below min_percent of memory, it
+// terminates the process with the most resident and swapped pages rather
+// than let every fault wait on memory that is not coming back.
+typedef struct {
+    int enabled;
+    int min_percent;
+    int score_adj[MAX_PROCESSES];  // Added to the score in thousandths of memory plus swap
+    long kills;
+    long pages_freed;  // Resident and swapped pages of the processes killed
+} OomKiller;
+
+OomKiller oom_killer = {.enabled = 1, .min_percent = OOM_DEFAULT_MIN_PERCENT};
+
+// Structure representing a log-linear latency histogram
+typedef struct {
+    long buckets[LATENCY_BUCKETS];
+    long count;
+    long total_ns;
+} LatencyHistogram;
+
+LatencyHistogram fault_latency;  // Time spent in handle_page_fault()
+LatencyHistogram tier_latency[FAULT_TIERS];  // Fault time by where the page came from
+const char *fault_tier_names[FAULT_TIERS] = {"File/zero", "Compressed pool", "Swap file", "Page cache"};
+long minor_faults = 0;  // Faults served from memory: zero-filled or decompressed pages
+long major_faults = 0;  // Faults that read the executable image or the swap file
+
+// Structure representing a snapshot of the counters vmstat reports
+typedef struct {
+    int free_frames;
+    int used_frames;
+    long minor_faults;
+    long major_faults;
+    long evictions;
+    long dirty_evictions;  // Dirty pages the fault handler wrote back itself
+    long cleaner_writes;  // Dirty pages the cleaner wrote back
+    long swap_ins;
+    long swap_outs;
+    long zswap_pages;
+    long fault_ns;  // Time spent in the fault handler
+    long oom_kills;
+} VmstatSample;
+
+// Structure representing the thread that appends a VmstatSample to a CSV
+// file at a fixed interval
+typedef struct {
+    int running;
+    int interval_ms;
+    FILE *file;
+    char path[256];
+    long rows;
+    pthread_t thread;
+} VmstatLog;
+
+VmstatLog vmstat_log = {.interval_ms = VMSTAT_DEFAULT_INTERVAL_MS};
+pthread_cond_t vmstat_log_wakeup = PTHREAD_COND_INITIALIZER;
+
+// Structure representing a thread that faults pages in concurrently with
+// others. A fault that only needs a free frame and a fill is handled under
+// the page table's lock alone: the worker takes frames from its own cache,
+// like a per-CPU page list, and queues the replacement policy updates to
+// apply a batch at a time. Anything else goes through pager_lock.
+typedef struct {
+    _Alignas(64) atomic_int inside;  // 1 while the worker is in the fault gate
+    int frames[FRAME_CACHE_SIZE];  // Cached free frames
+    int cached;
+    int batch[FAULT_BATCH_SIZE];  // Frames with a queued policy update
+    char batch_kind[FAULT_BATCH_SIZE];  // FAULT_BATCH_* kind of each update
+    int batched;
+    int process_id;  // Process whose pages the worker touches
+    int pages;
+    int use_pager_lock;  // 1 to take pager_lock for every reference, for comparison
+    long fast_faults;  // Faults handled under the page table lock alone
+    long slow_references;  // References that needed pager_lock
+    LatencyHistogram fault_latency;  // Time spent in fast faults
+    pthread_t thread;
+} FaultWorker;
+
+// Structure representing one access for pager_access_batch()
+typedef struct {
+    int process_id;
+    int is_write;  // 1 for a store, 0 for a load
+    uint64_t vaddr;
+} PageAccess;
+
+// Fault workers enter a gate rather than taking pager_lock. Whoever holds
+// pager_lock closes the gate and waits for the workers inside to leave, so
+// code under pager_lock still has the pager to itself.
+FaultWorker fault_workers[FAULT_MAX_WORKERS];
+int fault_worker_count = 0;  // Workers in use, changed only under pager_lock
+atomic_int fault_gate_closed = 0;
+pthread_mutex_t zone_lock = PTHREAD_MUTEX_INITIALIZER;  // Buddy allocator, among workers in the gate
+pthread_mutex_t policy_lock = PTHREAD_MUTEX_INITIALIZER;  // Policy and dirty queue, among workers in the gate
+
+// Structure representing the readahead state of a process. Faults that keep
+// the same stride form a stream; once detected, the next window pages of the
+// stream are prefetched after each fault.
+typedef struct {
+    int last_page;  // Page of the previous fault, -1 if none
+    int stride;  // Distance between the last two faults, 0 if no stream
+    int run;  // Consecutive faults that followed the stride
+    int next_expected;  // Page where the stream's next fault should land
+    int window;  // Pages to prefetch per batch, 0 until first used
+    long batches;
+    long pages_prefetched;
+    long hits;  // Prefetched pages referenced before eviction
+    long waste;  // Prefetched pages evicted or freed unreferenced
+} ReadaheadState;
+
+ReadaheadState readahead_state[MAX_PROCESSES];
+int readahead_enabled = 1;
+int readahead_max_window = READAHEAD_MAX_WINDOW;
+
+// Messages the pager prints as it works: TRACE_EVENTS for rare events such as
+// suspensions and huge pages, TRACE_PAGES also for every page it moves. Off
+// by default, since printing a line per fault costs more than the fault.
+int pager_trace_level = TRACE_OFF;
+const char *trace_level_names[] = {"off", "events", "pages"};
 
 // Function forward declarations
 void free_page_table(PageTable *pt, int process_id);
+void show_meminfo();
+int reference_page(int process_id, int page_number, PageTable *pt);
+void show_policy_stats();
+int set_replacement_policy(const char *name);
+void reset_policy_stats();
+void simulate_trace(const char *filename, const char *curve_filename);
+void replay_trace(const char *filename, int repeat);
+void terminate_process(PageTable *pt, int process_id);
+void release_process_memory(PageTable *pt, int process_id);
+void unmap_process_image(int process_id);
+void lock_pager();
+void unlock_pager();
+void drain_fault_batch(FaultWorker *worker);
+void fault_benchmark(int max_threads, int pages, int use_pager_lock);
+void live_pager_run(int pages, int passes, int random_order);
+void live_pager_evict(int process_id, int page_number, int frame_number);
+int live_pager_frame(int frame_number);
+void tlb_command(char **args);
+void cleaner_command(char **args);
+void merger_command(char **args);
+void huge_command(char **args);
+void buddy_command(char **args);
+void working_set_command(char **args);
+void stop_merger();
+void start_cleaner();
+void stop_cleaner();
+void dirty_queue_remove(int frame_number);
+void wait_for_writeback(int frame_number);
+void readahead_note_release(int frame_number);
+void readahead_command(char **args);
+void zswap_command(char **args);
+void vmstat_command(char **args);
+void overcommit_command(char **args);
+void oom_command(char **args);
+void page_cache_command(char **args);
+void mmap_command(char **args);
+void munmap_command(char **args);
+int commit_pages(int process_id, long pages);
+int commit_allowed(long pages);
+long commit_limit();
+const char *map_executable_image(int process_id, int image_id);
+void clone_process(int source_id, int clone_id);
+PageTableEntry *break_cow(int process_id, int page_number);
+void print_latency_summary(const char *label, LatencyHistogram *histogram);
 void cleanup_process_resources(int process_id);
+int page_cache_remove(int frame_number);
 void set_path_environment();
 
 // Array to store command history
@@ -143,6 +738,141 @@ void execute_command(char *command, int process_id, PageTable *pt) {
     } else if (strcmp(args[0], "history") == 0) {
         show_history();
         return;
+    } else if (strcmp(args[0], "meminfo") == 0) {
+        lock_pager();
+        show_meminfo();
+        unlock_pager();
+        return;
+    } else if (strcmp(args[0], "policy") == 0) {
+        lock_pager();
+        if (args[1] == NULL) {
+            show_policy_stats();
+        } else if (strcmp(args[1], "reset") == 0) {
+            reset_policy_stats();
+        } else if (set_replacement_policy(args[1]) != 0) {
+            fprintf(stderr, "policy: unknown policy '%s'\n", args[1]);
+        }
+        unlock_pager();
+        return;
+    } else if (strcmp(args[0], "tlb") == 0) {
+        lock_pager();
+        tlb_command(args);
+        unlock_pager();
+        return;
+    } else if (strcmp(args[0], "readahead") == 0) {
+        lock_pager();
+        readahead_command(args);
+        unlock_pager();
+        return;
+    } else if (strcmp(args[0], "zswap") == 0) {
+        lock_pager();
+        zswap_command(args);
+        unlock_pager();
+        return;
+    } else if (strcmp(args[0], "buddy") == 0) {
+        lock_pager();
+        buddy_command(args);
+        unlock_pager();
+        return;
+    } else if (strcmp(args[0], "ws") == 0) {
+        lock_pager();
+        working_set_command(args);
+        unlock_pager();
+        return;
+    } else if (strcmp(args[0], "huge") == 0) {
+        lock_pager();
+        huge_command(args);
+        unlock_pager();
+        return;
+    } else if (strcmp(args[0], "merge") == 0) {
+        merger_command(args);
+        return;
+    } else if (strcmp(args[0], "cleaner") == 0) {
+        cleaner_command(args);
+        return;
+    } else if (strcmp(args[0], "vmstat") == 0) {
+        vmstat_command(args);
+        return;
+    } else if (strcmp(args[0], "overcommit") == 0) {
+        overcommit_command(args);
+        return;
+    } else if (strcmp(args[0], "oom") == 0) {
+        oom_command(args);
+        return;
+    } else if (strcmp(args[0], "pagecache") == 0) {
+        lock_pager();
+        page_cache_command(args);
+        unlock_pager();
+        return;
+    } else if (strcmp(args[0], "mmap") == 0) {
+        mmap_command(args);
+        return;
+    } else if (strcmp(args[0], "munmap") == 0) {
+        munmap_command(args);
+        return;
+    } else if (strcmp(args[0], "simulate") == 0) {
+        if (args[1] == NULL) {
+            fprintf(stderr, "simulate: expected trace file\n");
+        } else {
+            simulate_trace(args[1], args[2]);
+        }
+        return;
+    } else if (strcmp(args[0], "replay") == 0) {
+        int repeat = args[1] != NULL && args[2] != NULL ? atoi(args[2]) : 1;
+        if (args[1] == NULL || repeat < 1) {
+            fprintf(stderr, "replay: usage: replay <trace> [<repeat>]\n");
+        } else {
+            replay_trace(args[1], repeat);
+        }
+        return;
+    } else if (strcmp(args[0], "clone") == 0) {
+        int source_id = args[1] != NULL ? atoi(args[1]) : -1;
+        int clone_id = args[1] != NULL && args[2] != NULL ? atoi(args[2]) : -1;
+        lock_pager();
+        if (source_id < 0 || source_id >= MAX_PROCESSES || clone_id < 0 || clone_id >= MAX_PROCESSES) {
+            fprintf(stderr, "clone: usage: clone <source pid> <new pid> (pids 0-%d)\n", MAX_PROCESSES - 1);
+        } else if (page_tables[source_id].num_entries == 0) {
+            fprintf(stderr, "clone: process %d does not exist\n", source_id);
+        } else if (page_tables[clone_id].num_entries != 0) {
+            fprintf(stderr, "clone: process %d already exists\n", clone_id);
+        } else if (commit_pages(clone_id, overcommit.process_pages[source_id]) != 0) {
+            fprintf(stderr, "clone: cannot commit %ld pages for process %d under overcommit mode %s\n",
+                    overcommit.process_pages[source_id], clone_id, overcommit_mode_names[overcommit.mode]);
+        } else {
+            clone_process(source_id, clone_id);
+        }
+        unlock_pager();
+        return;
+    } else if (strcmp(args[0], "faultbench") == 0) {
+        int max_threads = args[1] != NULL ? atoi(args[1]) : FAULT_MAX_WORKERS;
+        int pages = args[1] != NULL && args[2] != NULL ? atoi(args[2]) : FAULT_BENCH_DEFAULT_PAGES;
+        int use_pager_lock = args[1] != NULL && args[2] != NULL && args[3] != NULL && strcmp(args[3], "locked") == 0;
+        if (max_threads < 1 || max_threads > FAULT_MAX_WORKERS || pages < 1 || pages > VIRTUAL_PAGES) {
+            fprintf(stderr, "faultbench: usage: faultbench [<max threads 1-%d> [<pages per thread> [locked]]]\n", FAULT_MAX_WORKERS);
+        } else {
+            fault_benchmark(max_threads, pages, use_pager_lock);
+        }
+        return;
+    } else if (strcmp(args[0], "live") == 0) {
+        int pages = args[1] != NULL ? atoi(args[1]) : LIVE_DEFAULT_PAGES;
+        int passes = args[1] != NULL && args[2] != NULL ? atoi(args[2]) : LIVE_DEFAULT_PASSES;
+        int random_order = args[1] != NULL && args[2] != NULL && args[3] != NULL && strcmp(args[3], "random") == 0;
+        if (pages < 1 || pages > VIRTUAL_PAGES || passes < 1) {
+            fprintf(stderr, "live: usage: live [<pages> [<passes> [random]]]\n");
+        } else {
+            live_pager_run(pages, passes, random_order);
+        }
+        return;
+    } else if (strcmp(args[0], "ref") == 0) {
+        if (args[1] == NULL) {
+            fprintf(stderr, "ref: expected page numbers\n");
+        }
+        lock_pager();
+        for (int j = 1; args[j] != NULL; j++) {
+            reference_page(process_id, atoi(args[j]), pt);
+        }
+        unlock_pager();
+        return;
     }
 
     // Fork a child process to execute the command
@@ -186,242 +916,5605 @@ void batch_mode(const char *filename) {
     }
 }
 
-// Function to initialize a page table for a process
+// Function to initialize a page table for a process. Nothing is allocated
+// until the first page is mapped.
 void init_page_table(PageTable *pt, int num_pages) {
     pt->num_entries = num_pages;
-    pt->entries = (PageTableEntry *)malloc(num_pages * sizeof(PageTableEntry));
-    for (int i = 0; i < num_pages; i++) {
-        pt->entries[i].frame_number = -1;
-        pt->entries[i].valid = 0;
-        pt->entries[i].modified = 0;
-    }
+    pt->directory = NULL;
+    pt->num_leaves = 0;
+    pt->resident_pages = 0;
 }
 
-// Function to calculate the number of pages needed for a process
-int calculate_pages_needed(int process_memory) {
-    return (process_memory + PAGE_SIZE - 1) / PAGE_SIZE;
+// Function to get the number of directory slots of a page table
+int pt_directory_size(PageTable *pt) {
+    return (pt->num_entries + PT_LEAF_SIZE - 1) / PT_LEAF_SIZE;
 }
 
-// Function to initialize the frame table
-void init_frame_table() {
-    for (int i = 0; i < MAX_FRAMES; i++) {
-        frame_table[i].is_free = 1;
-        frame_table[i].process_id = -1;
-        frame_table[i].page_number = -1;
+// Function to look up the entry for a page, NULL if its leaf is not allocated
+PageTableEntry *pt_lookup(PageTable *pt, int page_number) {
+    if (pt->directory == NULL || page_number < 0 || page_number >= pt->num_entries) {
+        return NULL;
     }
+    PageTableLeaf *leaf = pt->directory[page_number >> PT_LEAF_BITS];
+    if (leaf == NULL) {
+        return NULL;
+    }
+    return &leaf->entries[page_number & (PT_LEAF_SIZE - 1)];
 }
 
-// Function to allocate a frame for a process
-int allocate_frame(int process_id, int page_number) {
-    for (int i = 0; i < MAX_FRAMES; i++) {
-        if (frame_table[i].is_free) {
-            frame_table[i].is_free = 0;
-            frame_table[i].process_id = process_id;
-            frame_table[i].page_number = page_number;
-            return i;
+// Function to look up the entry for a page, allocating the directory and leaf if needed
+PageTableEntry *pt_lookup_create(PageTable *pt, int page_number) {
+    if (page_number < 0 || page_number >= pt->num_entries) {
+        return NULL;
+    }
+    if (pt->directory == NULL) {
+        pt->directory = calloc(pt_directory_size(pt), sizeof(PageTableLeaf *));
+        if (pt->directory == NULL) {
+            perror("Error allocating page directory");
+            exit(1);
+        }
+        page_table_bytes += pt_directory_size(pt) * sizeof(PageTableLeaf *);
+    }
+
+    PageTableLeaf **slot = &pt->directory[page_number >> PT_LEAF_BITS];
+    if (*slot == NULL) {
+        PageTableLeaf *leaf = malloc(sizeof(PageTableLeaf));
+        if (leaf == NULL) {
+            perror("Error allocating page table leaf");
+            exit(1);
         }
+        for (int i = 0; i < PT_LEAF_SIZE; i++) {
+            leaf->entries[i].frame_number = -1;
+            leaf->entries[i].valid = 0;
+            leaf->entries[i].modified = 0;
+            leaf->entries[i].swap_slot = -1;
+            leaf->entries[i].zswap_entry = -1;
+        }
+        leaf->live_entries = 0;
+        leaf->resident_entries = 0;
+        leaf->huge_frame = -1;
+        *slot = leaf;
+        pt->num_leaves++;
+        page_table_bytes += sizeof(PageTableLeaf);
     }
-    return -1;  // No free frame found
+    return &(*slot)->entries[page_number & (PT_LEAF_SIZE - 1)];
 }
 
-// Function to free a frame
-void free_frame(int frame_number) {
-    frame_table[frame_number].is_free = 1;
-    frame_table[frame_number].process_id = -1;
-    frame_table[frame_number].page_number = -1;
+// Function to check whether a page table entry holds any state worth keeping
+int pte_in_use(PageTableEntry *entry) {
+    return entry->valid || entry->swap_slot != -1 || entry->zswap_entry != -1;
 }
 
-// Function to load a page from an executable file into a frame
-void load_page_from_executable(int process_id, int page_number, int frame) {
-    char filename[256];
-    snprintf(filename, sizeof(filename), "process_%d_executable.bin", process_id);
+// Function to split a huge page back into 4 KB mappings. The leaf's entries
+// already map every page, so only the leaf-wide mapping goes away; callers
+// shoot down the page they change, which drops the huge TLB entry with it.
+void pt_demote_leaf(PageTableLeaf *leaf) {
+    leaf->huge_frame = -1;
+    huge_pages.mapped--;
+    huge_pages.demotions++;
+}
 
-    int fd = open(filename, O_RDONLY);
-    if (fd == -1) {
-        perror("Error opening executable file");
-        return;
+// Function to map a page to a frame
+void pt_map_page(PageTable *pt, int page_number, int frame) {
+    PageTableEntry *entry = pt_lookup_create(pt, page_number);
+    PageTableLeaf *leaf = pt->directory[page_number >> PT_LEAF_BITS];
+    if (!pte_in_use(entry)) {
+        leaf->live_entries++;
     }
-
-    off_t offset = page_number * PAGE_SIZE;
-    if (lseek(fd, offset, SEEK_SET) == -1) {
-        perror("Error seeking to page in executable file");
-        close(fd);
-        return;
+    if (!entry->valid) {
+        leaf->resident_entries++;
+        pt->resident_pages++;
     }
-
-    char buffer[PAGE_SIZE];
-    if (read(fd, buffer, PAGE_SIZE) != PAGE_SIZE) {
-        perror("Error reading page from executable file");
-        close(fd);
-        return;
+    if (leaf->huge_frame != -1 && frame != leaf->huge_frame + (page_number & (PT_LEAF_SIZE - 1))) {
+        pt_demote_leaf(leaf);
     }
-
-    printf("Loading page %d of process %d from executable into frame %d\n", page_number, process_id, frame);
-    close(fd);
+    entry->valid = 1;
+    entry->frame_number = frame;
+    entry->modified = 0;
 }
 
-// Function to write a page to swap space
-void write_page_to_swap(int process_id, int page_number) {
-    char filename[256];
-    snprintf(filename, sizeof(filename), "process_%d_swap.bin", process_id);
-
-    int fd = open(filename, O_WRONLY | O_CREAT, 0644);
-    if (fd == -1) {
-        perror("Error opening swap file");
+// Function to unmap a page, freeing its leaf once no entry in it is in use.
+// The page keeps its swap slot and compressed copy, if any.
+void pt_unmap_page(PageTable *pt, int page_number) {
+    PageTableEntry *entry = pt_lookup(pt, page_number);
+    if (entry == NULL || !pte_in_use(entry)) {
         return;
     }
-
-    off_t offset = page_number * PAGE_SIZE;
-    if (lseek(fd, offset, SEEK_SET) == -1) {
-        perror("Error seeking to page in swap file");
-        close(fd);
-        return;
+    PageTableLeaf **slot = &pt->directory[page_number >> PT_LEAF_BITS];
+    if (entry->valid) {
+        dirty_queue_remove(entry->frame_number);
+        (*slot)->resident_entries--;
+        pt->resident_pages--;
+        if ((*slot)->huge_frame != -1) {
+            pt_demote_leaf(*slot);
+        }
     }
-
-    char buffer[PAGE_SIZE];
-    memset(buffer, 0, PAGE_SIZE);  // Clear the buffer before writing
-
-    if (write(fd, buffer, PAGE_SIZE) != PAGE_SIZE) {
-        perror("Error writing page to swap file");
-        close(fd);
+    entry->valid = 0;
+    entry->frame_number = -1;
+    entry->modified = 0;
+    if (pte_in_use(entry)) {
         return;
     }
 
-    printf("Writing page %d of process %d to swap space\n", page_number, process_id);
-    close(fd);
+    if (--(*slot)->live_entries == 0) {
+        free(*slot);
+        *slot = NULL;
+        pt->num_leaves--;
+        page_table_bytes -= sizeof(PageTableLeaf);
+    }
 }
 
-// Function to check if a page is modified
-int is_page_modified(PageTable *pt, int page_number) {
-    return pt->entries[page_number].modified;
+// Function to calculate the number of pages needed for a process
+int calculate_pages_needed(int process_memory) {
+    return (process_memory + PAGE_SIZE - 1) / PAGE_SIZE;
 }
 
-// Function to update the LRU list
-void update_lru(int frame_number) {
-    lru_list[frame_number].frame_number = frame_number;
-    lru_list[frame_number].last_used_time = current_time++;
+// Function to get the size of physical memory in bytes
+long physical_memory_size() {
+    return (long)num_frames * PAGE_SIZE;
 }
 
-// Function to find the least recently used (LRU) frame
-int find_lru_frame() {
-    int lru_frame = 0;
-    for (int i = 1; i < MAX_FRAMES; i++) {
-        if (lru_list[i].last_used_time < lru_list[lru_frame].last_used_time) {
-            lru_frame = i;
+// Function to map the physical memory arena, optionally backed by explicit
+// huge pages. Falls back to normal pages with a transparent huge page hint.
+void init_physical_memory(int use_huge_pages) {
+    if (physical_memory != NULL) {
+        return;
+    }
+    void *arena = MAP_FAILED;
+    if (use_huge_pages) {
+        // Huge pages are reserved up front, so a short pool fails here rather than on first touch
+        arena = mmap(NULL, physical_memory_size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (arena == MAP_FAILED) {
+            perror("Huge pages unavailable, using normal pages");
+        }
+    }
+    physical_memory_huge = arena != MAP_FAILED;
+    if (arena == MAP_FAILED) {
+        arena = mmap(NULL, physical_memory_size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (arena == MAP_FAILED) {
+            perror("Error mapping physical memory");
+            exit(1);
+        }
+        if (use_huge_pages) {
+            madvise(arena, physical_memory_size(), MADV_HUGEPAGE);
         }
     }
-    return lru_frame;
+    physical_memory = arena;
 }
 
-// Function to handle a page fault
-void handle_page_fault(int process_id, int page_number, PageTable *pt) {
-    int frame = allocate_frame(process_id, page_number);
-    if (frame == -1) {
-        frame = find_lru_frame();
-        int old_process_id = frame_table[frame].process_id;
-        int old_page_number = frame_table[frame].page_number;
+// Function to get the data of a frame
+char *frame_data(int frame_number) {
+    return physical_memory + (size_t)frame_number * PAGE_SIZE;
+}
 
-        if (is_page_modified(&pt[old_process_id], old_page_number)) {
-            write_page_to_swap(old_process_id, old_page_number);
-        }
+// Function to link a free block into the free list of its order
+void buddy_list_push(int frame_number, int order) {
+    FrameTableEntry *head = &frame_table[frame_number];
+    head->free_head = 1;
+    head->free_order = order;
+    head->prev_free = -1;
+    head->next_free = buddy.free_lists[order];
+    if (head->next_free != -1) {
+        frame_table[head->next_free].prev_free = frame_number;
+    }
+    buddy.free_lists[order] = frame_number;
+    buddy.free_blocks[order]++;
+}
 
-        load_page_from_executable(process_id, page_number, frame);
-        frame_table[frame].process_id = process_id;
-        frame_table[frame].page_number = page_number;
+// Function to unlink a free block from the free list of its order
+void buddy_list_remove(int frame_number) {
+    FrameTableEntry *head = &frame_table[frame_number];
+    int order = head->free_order;
+    if (head->prev_free != -1) {
+        frame_table[head->prev_free].next_free = head->next_free;
     } else {
-        load_page_from_executable(process_id, page_number, frame);
+        buddy.free_lists[order] = head->next_free;
     }
-    pt->entries[page_number].valid = 1;
-    pt->entries[page_number].frame_number = frame;
-    pt->entries[page_number].modified = 0;
-    update_lru(frame);
+    if (head->next_free != -1) {
+        frame_table[head->next_free].prev_free = head->prev_free;
+    }
+    head->free_head = 0;
+    head->next_free = -1;
+    head->prev_free = -1;
+    buddy.free_blocks[order]--;
 }
 
-// Function to clean up resources for a process
-void cleanup_process_resources(int process_id) {
-    ProcessResources *resources = &process_resources[process_id];
+// Function to map a zeroed array with an element for each frame. The
+// kernel backs it on first touch, so untouched frames cost no memory.
+void *allocate_frame_array(size_t element_size, int elements) {
+    void *array = mmap(NULL, element_size * elements, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (array == MAP_FAILED) {
+        perror("Error allocating frame metadata");
+        exit(1);
+    }
+    return array;
+}
 
-    // Free dynamically allocated memory blocks
-    for (int i = 0; i < resources->num_allocated_blocks; i++) {
-        free(resources->allocated_memory[i]);
-        resources->allocated_memory[i] = NULL;
+// Function to initialize the frame table
+void init_frame_table() {
+    frame_table = allocate_frame_array(sizeof(FrameTableEntry), num_frames);
+    lru_list = allocate_frame_array(sizeof(LRUEntry), num_frames);
+    merge_checksums = allocate_frame_array(sizeof(uint32_t), num_frames);
+    frame_last_reference = allocate_frame_array(sizeof(long), num_frames);
+    for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+        process_frame_head[process_id] = -1;
+        process_frame_count[process_id] = 0;
+    }
+    for (int order = 0; order < BUDDY_ORDERS; order++) {
+        buddy.free_lists[order] = -1;
+        buddy.free_blocks[order] = 0;
     }
 
-    // Close open file descriptors
-    for (int i = 0; i < resources->num_open_files; i++) {
-        if (resources->open_files[i] != -1) {
-            close(resources->open_files[i]);
-            resources->open_files[i] = -1;
+    // Carve the frames into the largest aligned blocks that fit. Blocks are
+    // pushed from the top down, so the lowest frames are handed out first.
+    for (int end = num_frames; end > 0;) {
+        int order = BUDDY_ORDERS - 1;
+        int start;
+        while ((start = end - (1 << order)) < 0 || start % (1 << order) != 0) {
+            order--;
         }
+        buddy_list_push(start, order);
+        end = start;
     }
+    free_frame_count = num_frames;
+    used_frame_count = 0;
+    init_physical_memory(0);
+}
 
-    // Reset the resource counts
-    resources->num_allocated_blocks = 0;
-    resources->num_open_files = 0;
+// Function to allocate a block of 2^order frames, splitting a larger free
+// block if no block of that order is free. The frames belong to no page yet.
+// Returns the first frame, -1 if no free block is large enough.
+int buddy_allocate(int order) {
+    int found = order;
+    while (found < BUDDY_ORDERS && buddy.free_lists[found] == -1) {
+        found++;
+    }
+    if (found == BUDDY_ORDERS) {
+        buddy.failures++;
+        return -1;
+    }
 
-    printf("Cleaned up resources for process %d\n", process_id);
+    int frame = buddy.free_lists[found];
+    buddy_list_remove(frame);
+    while (found > order) {
+        // Keep the lower half and free the upper half
+        found--;
+        buddy_list_push(frame + (1 << found), found);
+        buddy.splits++;
+    }
+    for (int i = 0; i < (1 << order); i++) {
+        FrameTableEntry *entry = &frame_table[frame + i];
+        entry->in_use = 1;
+        entry->process_id = -1;
+        entry->page_number = -1;
+        entry->rmap_head = -1;
+    }
+    free_frame_count -= 1 << order;
+    used_frame_count += 1 << order;
+    buddy.allocations++;
+    return frame;
 }
 
-// Function to terminate a process
-void terminate_process(PageTable *pt, int process_id) {
-    for (int i = 0; i < MAX_FRAMES; i++) {
-        if (frame_table[i].process_id == process_id) {
-            free_frame(i);
+// Function to free a block of 2^order frames, merging it with its buddy for
+// as long as the buddy is a free block of the same order
+void buddy_free(int frame_number, int order) {
+    for (int i = 0; i < (1 << order); i++) {
+        frame_table[frame_number + i].in_use = 0;
+    }
+    free_frame_count += 1 << order;
+    used_frame_count -= 1 << order;
+    while (order < BUDDY_ORDERS - 1) {
+        int buddy_frame = frame_number ^ (1 << order);
+        if (buddy_frame + (1 << order) > num_frames || !frame_table[buddy_frame].free_head || frame_table[buddy_frame].free_order != order) {
+            break;
         }
+        buddy_list_remove(buddy_frame);
+        frame_number = frame_number < buddy_frame ? frame_number : buddy_frame;
+        order++;
+        buddy.merges++;
     }
+    buddy_list_push(frame_number, order);
+}
 
-    free_page_table(pt, process_id);
-    cleanup_process_resources(process_id);
+// Function to get the smallest order whose blocks hold the given number of frames
+int buddy_order_for(int frames) {
+    int order = 0;
+    while ((1 << order) < frames) {
+        order++;
+    }
+    return order;
 }
 
-// Function to free the page table for a process
-void free_page_table(PageTable *pt, int process_id) {
-    free(pt[process_id].entries);
-    pt[process_id].num_entries = 0;
+// Function to set the page a frame holds, moving the frame to the list of
+// the process that now owns it. A process_id of -1 leaves it to no process.
+void set_frame_owner(int frame_number, int process_id, int page_number) {
+    FrameTableEntry *frame = &frame_table[frame_number];
+    if (frame->process_id != process_id) {
+        if (frame->process_id != -1) {
+            if (frame->owner_prev != -1) {
+                frame_table[frame->owner_prev].owner_next = frame->owner_next;
+            } else {
+                process_frame_head[frame->process_id] = frame->owner_next;
+            }
+            if (frame->owner_next != -1) {
+                frame_table[frame->owner_next].owner_prev = frame->owner_prev;
+            }
+            process_frame_count[frame->process_id]--;
+        }
+        frame->owner_prev = -1;
+        frame->owner_next = -1;
+        if (process_id != -1) {
+            frame->owner_next = process_frame_head[process_id];
+            if (frame->owner_next != -1) {
+                frame_table[frame->owner_next].owner_prev = frame_number;
+            }
+            process_frame_head[process_id] = frame_number;
+            process_frame_count[process_id]++;
+        }
+        frame->process_id = process_id;
+    }
+    frame->page_number = page_number;
 }
 
-// Function to allocate resources for a process
-void allocate_resources_for_process(int process_id) {
-    ProcessResources *resources = &process_resources[process_id];
+// Function to allocate a frame for a process
+int allocate_frame(int process_id, int page_number) {
+    int frame = buddy_allocate(0);
+    if (frame == -1) {
+        return -1;  // No free frame found
+    }
+    set_frame_owner(frame, process_id, page_number);
+    frame_table[frame].map_count = 1;
+    frame_last_reference[frame] = working_sets[process_id].virtual_time;
+    return frame;
+}
 
-    // Simulate allocating memory blocks
-    resources->allocated_memory = malloc(10 * sizeof(void *));  // Allocate array for 10 blocks
-    resources->num_allocated_blocks = 10;
-    for (int i = 0; i < 10; i++) {
-        resources->allocated_memory[i] = malloc(1024);  // Allocate 1 KB blocks
+// Function to allocate an aligned 2 MB block of frames for the pages of a
+// leaf, starting at first_page. Returns the first frame, -1 if no block is free.
+int allocate_huge_frame(int process_id, int first_page) {
+    int base = buddy_allocate(HUGE_PAGE_ORDER);
+    for (int i = 0; base != -1 && i < HUGE_PAGE_FRAMES; i++) {
+        set_frame_owner(base + i, process_id, first_page + i);
+        frame_table[base + i].map_count = 1;
+        frame_last_reference[base + i] = working_sets[process_id].virtual_time;
     }
+    return base;
+}
 
-    // Simulate opening file descriptors
-    resources->num_open_files = 3;
-    resources->open_files[0] = open("file1.txt", O_RDONLY | O_CREAT, 0644);
-    resources->open_files[1] = open("file2.txt", O_WRONLY | O_CREAT, 0644);
-    resources->open_files[2] = open("file3.txt", O_RDWR | O_CREAT, 0644);
+// Function to count the free 2 MB blocks, including those inside larger free blocks
+int free_huge_frame_count() {
+    int count = 0;
+    for (int order = HUGE_PAGE_ORDER; order < BUDDY_ORDERS; order++) {
+        count += buddy.free_blocks[order] << (order - HUGE_PAGE_ORDER);
+    }
+    return count;
 }
 
-// Function to set the PATH environment variable
-void set_path_environment() {
-    setenv("PATH", "/bin:/usr/bin:/usr/local/bin", 1);
+// Function to check whether a frame holds a page of a process, rather than
+// being free or allocated to the shell itself
+int frame_holds_page(int frame_number) {
+    return frame_table[frame_number].in_use && frame_table[frame_number].process_id != -1;
 }
 
-int main(int argc, char *argv[]) {
-    // Set up signal handlers
-    signal(SIGINT, handle_signal);
-    signal(SIGQUIT, handle_signal);
+// Function to free a frame
+void free_frame(int frame_number) {
+    if (!frame_table[frame_number].in_use) {
+        return;  // Already free
+    }
 
-    set_path_environment();  // Set the PATH environment variable
+    current_policy->on_remove(frame_number, 0);  // A free frame can no longer be a replacement victim
+    dirty_queue_remove(frame_number);
+    readahead_note_release(frame_number);
+    page_cache_remove(frame_number);
+    set_frame_owner(frame_number, -1, -1);
+    frame_table[frame_number].map_count = 0;
+    frame_table[frame_number].merged = 0;
+    buddy_free(frame_number, 0);
+}
 
-    init_frame_table();  // Initialize the frame table
+// Function to add a mapping of a page to the reverse map of a frame it shares
+void rmap_add(int frame_number, int process_id, int page_number) {
+    if (rmap_free_head == -1) {
+        int capacity = rmap_capacity ? rmap_capacity * 2 : 1024;
+        RmapEntry *entries = realloc(rmap_entries, capacity * sizeof(RmapEntry));
+        if (entries == NULL) {
+            perror("Error growing reverse map");
+            exit(1);
+        }
+        for (int i = capacity - 1; i >= rmap_capacity; i--) {
+            entries[i].next = rmap_free_head;
+            rmap_free_head = i;
+        }
+        rmap_entries = entries;
+        rmap_capacity = capacity;
+    }
 
-    if (argc == 2) {
-        batch_mode(argv[1]);  // Run in batch mode if a filename is provided
-    } else {
-        char input[MAX_INPUT_SIZE];
-        PageTable pt[100];
-        int process_id = 1;
-        int process_memory = 1000000;
-        int num_pages = calculate_pages_needed(process_memory);
+    int index = rmap_free_head;
+    rmap_free_head = rmap_entries[index].next;
+    rmap_entries[index].process_id = process_id;
+    rmap_entries[index].page_number = page_number;
+    rmap_entries[index].next = frame_table[frame_number].rmap_head;
+    frame_table[frame_number].rmap_head = index;
+    if (++frame_table[frame_number].map_count == 2) {
+        shared_frame_count++;
+    }
+}
 
-        init_page_table(&pt[process_id], num_pages);  // Initialize the page table for the process
+// Function to remove one mapping from a shared frame. If it was the frame's
+// primary mapping, the next sharer takes its place.
+void rmap_remove(int frame_number, int process_id, int page_number) {
+    FrameTableEntry *frame = &frame_table[frame_number];
+    int *link = &frame->rmap_head;
+    if (frame->process_id == process_id && frame->page_number == page_number) {
+        if (*link == -1) {
+            return;  // The last mapping goes with free_frame()
+        }
+        set_frame_owner(frame_number, rmap_entries[*link].process_id, rmap_entries[*link].page_number);
+    } else {
+        while (*link != -1 && (rmap_entries[*link].process_id != process_id ||
+                               rmap_entries[*link].page_number != page_number)) {
+            link = &rmap_entries[*link].next;
+        }
+        if (*link == -1) {
+            return;
+        }
+    }
+
+    int index = *link;
+    *link = rmap_entries[index].next;
+    rmap_entries[index].next = rmap_free_head;
+    rmap_free_head = index;
+    if (--frame->map_count == 1) {
+        shared_frame_count--;
+    }
+}
+
+// Function to drop every sharer of a frame but its primary mapping
+void rmap_clear(int frame_number) {
+    FrameTableEntry *frame = &frame_table[frame_number];
+    while (frame->rmap_head != -1) {
+        int index = frame->rmap_head;
+        frame->rmap_head = rmap_entries[index].next;
+        rmap_entries[index].next = rmap_free_head;
+        rmap_free_head = index;
+    }
+    if (frame->map_count > 1) {
+        shared_frame_count--;
+    }
+    frame->map_count = 1;
+}
+
+// Function to step through the mappings of a frame, primary first. Start with
+// *position set to -2; returns 0 once every mapping has been visited.
+int next_frame_mapping(int frame_number, int *position, int *process_id, int *page_number) {
+    if (*position == -2) {
+        *process_id = frame_table[frame_number].process_id;
+        *page_number = frame_table[frame_number].page_number;
+        *position = frame_table[frame_number].rmap_head;
+        return 1;
+    }
+    if (*position == -1) {
+        return 0;
+    }
+    *process_id = rmap_entries[*position].process_id;
+    *page_number = rmap_entries[*position].page_number;
+    *position = rmap_entries[*position].next;
+    return 1;
+}
+
+// Function to drop one process's mapping of a frame, freeing the frame with its last mapping
+void release_frame_mapping(int frame_number, int process_id, int page_number) {
+    if (frame_table[frame_number].map_count > 1) {
+        rmap_remove(frame_number, process_id, page_number);
+    } else {
+        free_frame(frame_number);
+    }
+}
+
+// Function to check whether any page mapping a frame belongs to a huge page
+int frame_in_huge_page(int frame_number) {
+    int position = -2, process_id, page_number;
+    while (next_frame_mapping(frame_number, &position, &process_id, &page_number)) {
+        if (page_tables[process_id].directory[page_number >> PT_LEAF_BITS]->huge_frame != -1) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Function to get the number of free frames
+int get_free_frame_count() {
+    return free_frame_count;
+}
+
+// Function to get the number of allocated frames
+int get_used_frame_count() {
+    return used_frame_count;
+}
+
+// Function to display physical memory usage
+void show_meminfo() {
+    printf("Frames total: %d\n", num_frames);
+    printf("Frames free:  %d\n", get_free_frame_count());
+    printf("Frames used:  %d\n", get_used_frame_count());
+    printf("Memory free:  %ld KB\n", (long)get_free_frame_count() * PAGE_SIZE / 1024);
+    printf("Memory used:  %ld KB\n", (long)get_used_frame_count() * PAGE_SIZE / 1024);
+    printf("Arena pages:  %s\n", physical_memory_huge ? "huge" : "normal");
+    printf("Page tables:  %ld KB\n", page_table_bytes / 1024);
+    printf("Swap total:   %ld KB\n", (long)SWAP_SLOTS * PAGE_SIZE / 1024);
+    printf("Swap used:    %ld KB\n", (long)swap_slots_used * PAGE_SIZE / 1024);
+    printf("Swap outs:    %ld\n", swap_outs);
+    printf("Swap ins:     %ld\n", swap_ins);
+    printf("Committed:    %ld KB of a %ld KB commit limit\n", overcommit.committed_pages * PAGE_SIZE / 1024,
+           commit_limit() * PAGE_SIZE / 1024);
+    printf("Zswap pool:   %ld KB holding %ld pages\n", zswap.pool_bytes / 1024, zswap.stored_pages);
+    printf("Shared:       %d frames shared copy-on-write, %ld pages copied on write\n", shared_frame_count, cow_copies);
+    printf("Page cache:   %ld KB holding %ld file pages\n", (long)page_cache.index.count * PAGE_SIZE / 1024, (long)page_cache.index.count);
+    printf("Huge pages:   %ld mapped (%ld KB), %d free 2 MB blocks\n", huge_pages.mapped,
+           huge_pages.mapped * HUGE_PAGE_FRAMES * PAGE_SIZE / 1024, free_huge_frame_count());
+}
+
+// Function to map a process's executable image into the shell's address
+// space. Done once per process; later calls return the cached mapping.
+// Returns NULL if the process has no image.
+const char *map_process_image(int process_id) {
+    ProcessResources *resources = &process_resources[process_id];
+    if (resources->executable_mapped) {
+        return resources->executable_image;
+    }
+    return map_executable_image(process_id, process_id);
+}
+
+// Function to map a file into the shell's address space, or take another
+// reference to it if it is already mapped under this or another name.
+// Returns its index in mapped_files, or -1 with errno set; an empty file
+// fails with EINVAL.
+int open_mapped_file(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    int free_slot = -1;
+    for (int i = 0; i < MAX_MAPPED_FILES; i++) {
+        if (mapped_files[i].users > 0 && mapped_files[i].device == st.st_dev && mapped_files[i].inode == st.st_ino) {
+            close(fd);
+            mapped_files[i].users++;
+            return i;
+        }
+        if (mapped_files[i].users == 0 && free_slot == -1) {
+            free_slot = i;
+        }
+    }
+    if (free_slot == -1) {
+        close(fd);
+        errno = EMFILE;
+        return -1;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // The mapping keeps the file alive
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    MappedFile *file = &mapped_files[free_slot];
+    snprintf(file->path, sizeof(file->path), "%s", path);
+    file->device = st.st_dev;
+    file->inode = st.st_ino;
+    file->data = data;
+    file->size = st.st_size;
+    file->users = 1;
+    file->cached_pages = 0;
+    return free_slot;
+}
+
+// Function to drop a reference to a mapped file, unmapping it with the last.
+// The page cache holds no frames for it by then, since every frame it caches
+// is mapped by a process that holds a reference.
+void release_mapped_file(int file) {
+    if (--mapped_files[file].users == 0) {
+        munmap(mapped_files[file].data, mapped_files[file].size);
+        mapped_files[file].data = NULL;
+        mapped_files[file].size = 0;
+    }
+}
+
+// Function to map the executable image of image_id as the image of a
+// process; a cloned process runs its parent's image. Returns NULL if there
+// is no image.
+const char *map_executable_image(int process_id, int image_id) {
+    ProcessResources *resources = &process_resources[process_id];
+    if (resources->executable_image != NULL) {
+        release_mapped_file(resources->executable_file);
+    }
+    resources->executable_mapped = 1;
+    resources->executable_image = NULL;
+    resources->executable_size = 0;
+
+    char filename[256];
+    snprintf(filename, sizeof(filename), "process_%d_executable.bin", image_id);
+    int file = open_mapped_file(filename);
+    if (file == -1) {
+        if (errno != ENOENT && errno != EINVAL) {
+            perror("Error mapping executable file");
+        }
+        return NULL;
+    }
+    resources->executable_image = mapped_files[file].data;
+    resources->executable_size = mapped_files[file].size;
+    resources->executable_file = file;
+    return resources->executable_image;
+}
+
+// Function to find the file page backing a page of a process: a page of a
+// file-backed region, else a page of the executable image. Returns the
+// file's index in mapped_files, or -1 for an anonymous page, which includes
+// pages past the end of their file.
+int page_backing_file(int process_id, int page_number, long *file_page) {
+    ProcessResources *resources = &process_resources[process_id];
+    for (int i = 0; i < resources->num_regions; i++) {
+        FileRegion *region = &resources->regions[i];
+        if (page_number >= region->first_page && page_number < region->first_page + region->pages) {
+            *file_page = region->file_page + (page_number - region->first_page);
+            return (size_t)*file_page * PAGE_SIZE < mapped_files[region->file].size ? region->file : -1;
+        }
+    }
+    if (map_process_image(process_id) == NULL || (size_t)page_number * PAGE_SIZE >= resources->executable_size) {
+        return -1;
+    }
+    *file_page = page_number;
+    return resources->executable_file;
+}
+
+// Function to load a page into a frame from the file backing it, or
+// zero-fill the frame if the page is anonymous
+void load_page_from_executable(int process_id, int page_number, int frame) {
+    long file_page;
+    int file = page_backing_file(process_id, page_number, &file_page);
+    char *data = frame_data(frame);
+    if (file == -1) {
+        memset(data, 0, PAGE_SIZE);
+        if (pager_trace_level >= TRACE_PAGES) {
+            printf("Zero-filling page %d of process %d into frame %d\n", page_number, process_id, frame);
+        }
+        return;
+    }
+
+    size_t size = mapped_files[file].size;
+    size_t offset = (size_t)file_page * PAGE_SIZE;
+    size_t bytes = size - offset < PAGE_SIZE ? size - offset : PAGE_SIZE;
+    memcpy(data, mapped_files[file].data + offset, bytes);
+    memset(data + bytes, 0, PAGE_SIZE - bytes);  // The tail of the file's last page is zero-filled
+
+    if (pager_trace_level >= TRACE_PAGES) {
+        printf("Loading page %d of process %d from %s into frame %d\n", page_number, process_id, mapped_files[file].path, frame);
+    }
+}
+
+// Function to open the swap device on first use. The file is unlinked right
+// away so that it disappears when the shell exits.
+int open_swap_device() {
+    if (swap_fd != -1) {
+        return 0;
+    }
+    swap_fd = open(SWAP_FILE, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (swap_fd == -1) {
+        perror("Error opening swap device");
+        return -1;
+    }
+    unlink(SWAP_FILE);
+    if (ftruncate(swap_fd, (off_t)SWAP_SLOTS * PAGE_SIZE) == -1) {
+        perror("Error sizing swap device");
+        close(swap_fd);
+        swap_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+// Function to allocate a free swap slot, -1 if swap is full
+int allocate_swap_slot() {
+    for (int scanned = 0; scanned < SWAP_MAP_WORDS; scanned++) {
+        int word = (swap_map_cursor + scanned) % SWAP_MAP_WORDS;
+        if (swap_map[word] != ~0ULL) {
+            int bit = __builtin_ctzll(~swap_map[word]);
+            swap_map[word] |= 1ULL << bit;
+            swap_count[word * 64 + bit] = 1;
+            swap_map_cursor = word;
+            swap_slots_used++;
+            return word * 64 + bit;
+        }
+    }
+    return -1;
+}
+
+// Function to drop a reference to a swap slot, releasing it with the last one
+void free_swap_slot(int slot) {
+    uint64_t bit = 1ULL << (slot % 64);
+    if ((swap_map[slot / 64] & bit) && --swap_count[slot] == 0) {
+        swap_map[slot / 64] &= ~bit;
+        swap_slots_used--;
+    }
+}
+
+// Function to give a page a swap slot it does not share, so that writing it
+// cannot clobber the copy other processes still refer to. Returns the slot,
+// -1 if swap is full.
+int own_swap_slot(PageTableEntry *entry) {
+    if (entry->swap_slot != -1 && swap_count[entry->swap_slot] > 1) {
+        free_swap_slot(entry->swap_slot);
+        entry->swap_slot = -1;
+    }
+    if (entry->swap_slot == -1) {
+        entry->swap_slot = allocate_swap_slot();
+    }
+    return entry->swap_slot;
+}
+
+// Function to write a page to swap space, giving it a swap slot if it has
+// none yet. Returns -1 if swap is full or the write failed.
+int write_page_to_swap(int process_id, int page_number, int frame) {
+    PageTableEntry *entry = pt_lookup(&page_tables[process_id], page_number);
+    if (entry == NULL || open_swap_device() != 0 || own_swap_slot(entry) == -1) {
+        return -1;
+    }
+
+    if (pwrite(swap_fd, frame_data(frame), PAGE_SIZE, (off_t)entry->swap_slot * PAGE_SIZE) != PAGE_SIZE) {
+        perror("Error writing page to swap file");
+        free_swap_slot(entry->swap_slot);  // The page must not refer to a slot that was never written
+        entry->swap_slot = -1;
+        return -1;
+    }
+    swap_outs++;
+
+    if (pager_trace_level >= TRACE_PAGES) {
+        printf("Writing page %d of process %d from frame %d to swap slot %d\n", page_number, process_id, frame, entry->swap_slot);
+    }
+    return 0;
+}
+
+// Function to write a dirty shared frame to a fresh swap slot that all of its
+// sharers then refer to, leaving each of them clean. Returns -1 if the frame
+// could not be written, in which case the sharers stay dirty.
+int write_shared_frame_to_swap(int frame) {
+    if (open_swap_device() != 0) {
+        return -1;
+    }
+    int slot = allocate_swap_slot();
+    if (slot == -1) {
+        return -1;
+    }
+    if (pwrite(swap_fd, frame_data(frame), PAGE_SIZE, (off_t)slot * PAGE_SIZE) != PAGE_SIZE) {
+        perror("Error writing page to swap file");
+        free_swap_slot(slot);  // The sharers must not refer to a slot that was never written
+        return -1;
+    }
+    swap_outs++;
+
+    int mappings = frame_table[frame].map_count;
+    swap_count[slot] = mappings;
+    int position = -2, process_id, page_number;
+    while (next_frame_mapping(frame, &position, &process_id, &page_number)) {
+        PageTableEntry *entry = pt_lookup(&page_tables[process_id], page_number);
+        if (entry->swap_slot != -1) {
+            free_swap_slot(entry->swap_slot);
+        }
+        entry->swap_slot = slot;
+        entry->modified = 0;
+    }
+    if (pager_trace_level >= TRACE_PAGES) {
+        printf("Writing frame %d shared by %d pages to swap slot %d\n", frame, mappings, slot);
+    }
+    return 0;
+}
+
+// Function to read a swapped-out page back from its swap slot into a frame
+void read_page_from_swap(int process_id, int page_number, int frame) {
+    PageTableEntry *entry = pt_lookup(&page_tables[process_id], page_number);
+    if (pread(swap_fd, frame_data(frame), PAGE_SIZE, (off_t)entry->swap_slot * PAGE_SIZE) != PAGE_SIZE) {
+        perror("Error reading page from swap file");
+        return;
+    }
+    swap_ins++;
+
+    if (pager_trace_level >= TRACE_PAGES) {
+        printf("Reading page %d of process %d from swap slot %d into frame %d\n", page_number, process_id, entry->swap_slot, frame);
+    }
+}
+
+// Function to get the number of extra bytes that encode a length whose token
+// nibble is saturated (15 + 255 + 255 + ... + remainder)
+int lz_extra_length_bytes(int length) {
+    return length < 15 ? 0 : (length - 15) / 255 + 1;
+}
+
+// Function to append a sequence of literals and, if match is nonzero, a match
+// at the given offset to a compressed buffer. Returns the new output
+// position, or -1 if the sequence does not fit.
+int lz_emit_sequence(unsigned char *dst, int op, int capacity, const unsigned char *literals, int count,
+                     int offset, int match) {
+    int length = match ? match - LZ_MIN_MATCH : 0;
+    int needed = 1 + lz_extra_length_bytes(count) + count + (match ? 2 + lz_extra_length_bytes(length) : 0);
+    if (needed > capacity - op) {
+        return -1;
+    }
+    dst[op++] = (unsigned char)((count < 15 ? count : 15) << 4 | (length < 15 ? length : 15));
+    if (count >= 15) {
+        int rest = count - 15;
+        for (; rest >= 255; rest -= 255) {
+            dst[op++] = 255;
+        }
+        dst[op++] = (unsigned char)rest;
+    }
+    memcpy(dst + op, literals, count);
+    op += count;
+    if (match) {
+        dst[op++] = (unsigned char)(offset & 0xff);
+        dst[op++] = (unsigned char)(offset >> 8);
+        if (length >= 15) {
+            int rest = length - 15;
+            for (; rest >= 255; rest -= 255) {
+                dst[op++] = 255;
+            }
+            dst[op++] = (unsigned char)rest;
+        }
+    }
+    return op;
+}
+
+// Function to compress a buffer with a small LZ77 coder in the style of LZ4.
+// Each sequence is a token (literal count and match length - 4, one nibble
+// each, 15 meaning more length bytes follow), the literals, and a 2-byte
+// offset and extra length bytes for the match. The last sequence has no match.
+// Returns the compressed size, or -1 if it would exceed capacity.
+int lz_compress(const unsigned char *src, int size, unsigned char *dst, int capacity) {
+    uint16_t table[1 << LZ_HASH_BITS];  // Position + 1 of the last 4 bytes with each hash
+    memset(table, 0, sizeof(table));
+    int ip = 0;
+    int anchor = 0;
+    int op = 0;
+    while (ip + LZ_MIN_MATCH <= size) {
+        uint32_t sequence;
+        memcpy(&sequence, src + ip, sizeof(sequence));
+        uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+        int candidate = table[hash] - 1;
+        table[hash] = (uint16_t)(ip + 1);
+        uint32_t previous;
+        if (candidate < 0 || ip - candidate > 0xffff ||
+            (memcpy(&previous, src + candidate, sizeof(previous)), previous != sequence)) {
+            ip += 1 + ((ip - anchor) >> 6);  // Skip faster through data that does not match
+            continue;
+        }
+
+        // Extend the match eight bytes at a time, then byte by byte
+        int match = LZ_MIN_MATCH;
+        while (ip + match + 8 <= size) {
+            uint64_t a, b;
+            memcpy(&a, src + candidate + match, sizeof(a));
+            memcpy(&b, src + ip + match, sizeof(b));
+            if (a != b) {
+                break;
+            }
+            match += 8;
+        }
+        while (ip + match < size && src[candidate + match] == src[ip + match]) {
+            match++;
+        }
+        op = lz_emit_sequence(dst, op, capacity, src + anchor, ip - anchor, ip - candidate, match);
+        if (op < 0) {
+            return -1;
+        }
+        ip += match;
+        anchor = ip;
+    }
+    return lz_emit_sequence(dst, op, capacity, src + anchor, size - anchor, 0, 0);
+}
+
+// Function to decompress the output of lz_compress(). Returns the
+// decompressed size, or -1 if the input is malformed or does not fit.
+int lz_decompress(const unsigned char *src, int size, unsigned char *dst, int capacity) {
+    int ip = 0;
+    int op = 0;
+    while (ip < size) {
+        int token = src[ip++];
+        int literals = token >> 4;
+        if (literals == 15) {
+            int extra;
+            do {
+                if (ip >= size) {
+                    return -1;
+                }
+                extra = src[ip++];
+                literals += extra;
+            } while (extra == 255);
+        }
+        if (literals > size - ip || literals > capacity - op) {
+            return -1;
+        }
+        memcpy(dst + op, src + ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == size) {
+            break;  // The last sequence has no match
+        }
+
+        if (size - ip < 2) {
+            return -1;
+        }
+        int offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        int length = (token & 15) + LZ_MIN_MATCH;
+        if ((token & 15) == 15) {
+            int extra;
+            do {
+                if (ip >= size) {
+                    return -1;
+                }
+                extra = src[ip++];
+                length += extra;
+            } while (extra == 255);
+        }
+        if (offset == 0 || offset > op || length > capacity - op) {
+            return -1;
+        }
+        if (offset == 1) {
+            memset(dst + op, dst[op - 1], length);  // A run of one byte
+        } else if (offset >= length) {
+            memcpy(dst + op, dst + op - offset, length);
+        } else {
+            for (int i = 0; i < length; i++) {
+                dst[op + i] = dst[op + i - offset];  // Byte by byte, since the match overlaps itself
+            }
+        }
+        op += length;
+    }
+    return op;
+}
+
+// Function to get the pool budget in bytes
+long zswap_budget() {
+    return physical_memory_size() / 100 * zswap.max_percent;
+}
+
+// Function to unlink a pool entry from the LRU list
+void zswap_lru_unlink(int index) {
+    ZswapEntry *entry = &zswap.entries[index];
+    if (entry->prev != -1) {
+        zswap.entries[entry->prev].next = entry->next;
+    } else {
+        zswap.lru_head = entry->next;
+    }
+    if (entry->next != -1) {
+        zswap.entries[entry->next].prev = entry->prev;
+    } else {
+        zswap.lru_tail = entry->prev;
+    }
+}
+
+// Function to drop a page's compressed copy
+void zswap_drop(PageTableEntry *pte) {
+    ZswapEntry *entry = &zswap.entries[pte->zswap_entry];
+    zswap_lru_unlink(pte->zswap_entry);
+    free(entry->data);
+    entry->data = NULL;
+    zswap.pool_bytes -= entry->size;
+    zswap.stored_pages--;
+    entry->next = zswap.free_head;
+    zswap.free_head = pte->zswap_entry;
+    pte->zswap_entry = -1;
+}
+
+// Function to write the oldest page in the pool back to its swap slot and
+// drop it from the pool. A copy that fails to decompress is dropped without
+// being written, and the page is lost. Returns -1 if the pool is empty or
+// swap is full.
+int zswap_writeback_oldest() {
+    int index = zswap.lru_tail;
+    if (index == -1 || open_swap_device() != 0) {
+        return -1;
+    }
+    ZswapEntry *entry = &zswap.entries[index];
+    int process_id = PAGE_KEY_PROCESS(entry->key);
+    int page_number = PAGE_KEY_PAGE(entry->key);
+    PageTableEntry *pte = pt_lookup(&page_tables[process_id], page_number);
+    if (own_swap_slot(pte) == -1) {
+        return -1;
+    }
+
+    unsigned char buffer[PAGE_SIZE];
+    if (lz_decompress(entry->data, entry->size, buffer, PAGE_SIZE) != PAGE_SIZE) {
+        fprintf(stderr, "Compressed copy of page %d of process %d is corrupt, the page is lost\n", page_number, process_id);
+        free_swap_slot(pte->swap_slot);  // Never written, so the page must not fault it in
+        pte->swap_slot = -1;
+        zswap_drop(pte);
+        return 0;
+    }
+    if (pwrite(swap_fd, buffer, PAGE_SIZE, (off_t)pte->swap_slot * PAGE_SIZE) != PAGE_SIZE) {
+        perror("Error writing back compressed page to swap file");
+        return -1;
+    }
+    swap_outs++;
+    zswap.writebacks++;
+    zswap_drop(pte);
+    return 0;
+}
+
+// Function to add a compressed page to the pool as the most recently stored
+// one, replacing any older copy of the page. Returns the entry's index, -1 if
+// the pool cannot grow.
+int zswap_insert(int process_id, int page_number, const unsigned char *compressed, int size) {
+    unsigned char *data = malloc(size);
+    if (data == NULL) {
+        return -1;
+    }
+    memcpy(data, compressed, size);
+
+    PageTableEntry *pte = pt_lookup(&page_tables[process_id], page_number);
+    if (pte->zswap_entry != -1) {
+        zswap_drop(pte);  // Replace an older copy
+    }
+    if (zswap.free_head == -1) {
+        int capacity = zswap.capacity ? zswap.capacity * 2 : 1024;
+        ZswapEntry *entries = realloc(zswap.entries, capacity * sizeof(ZswapEntry));
+        if (entries == NULL) {
+            perror("Error growing compressed pool");
+            free(data);
+            return -1;
+        }
+        for (int i = capacity - 1; i >= zswap.capacity; i--) {
+            entries[i].data = NULL;
+            entries[i].next = zswap.free_head;
+            zswap.free_head = i;
+        }
+        zswap.entries = entries;
+        zswap.capacity = capacity;
+    }
+
+    int index = zswap.free_head;
+    ZswapEntry *entry = &zswap.entries[index];
+    zswap.free_head = entry->next;
+    entry->key = PAGE_KEY(process_id, page_number);
+    entry->data = data;
+    entry->size = size;
+    entry->prev = -1;
+    entry->next = zswap.lru_head;
+    if (zswap.lru_head != -1) {
+        zswap.entries[zswap.lru_head].prev = index;
+    } else {
+        zswap.lru_tail = index;
+    }
+    zswap.lru_head = index;
+    pte->zswap_entry = index;
+    zswap.pool_bytes += size;
+    zswap.stored_pages++;
+    return index;
+}
+
+// Function to write back the oldest pages while the pool is over budget,
+// sparing the entry given
+void zswap_shrink(int keep) {
+    while (zswap.pool_bytes > zswap_budget() && zswap.lru_tail != -1 && zswap.lru_tail != keep) {
+        if (zswap_writeback_oldest() != 0) {
+            break;
+        }
+    }
+}
+
+// Function to compress a page into the pool, writing back the oldest pages
+// while the pool is over budget. Returns -1 if the pool is off or the page
+// compresses too poorly, in which case the caller writes it to swap.
+int zswap_store(int process_id, int page_number, int frame) {
+    if (!zswap.enabled) {
+        return -1;
+    }
+    unsigned char buffer[ZSWAP_MAX_COMPRESSED];
+    int size = lz_compress((unsigned char *)frame_data(frame), PAGE_SIZE, buffer, sizeof(buffer));
+    if (size < 0) {
+        zswap.rejects++;
+        return -1;
+    }
+    int index = zswap_insert(process_id, page_number, buffer, size);
+    if (index == -1) {
+        return -1;
+    }
+    zswap.stores++;
+    zswap.stored_bytes += size;
+
+    if (pager_trace_level >= TRACE_PAGES) {
+        printf("Compressed page %d of process %d from frame %d to %d bytes\n", page_number, process_id, frame, size);
+    }
+    zswap_shrink(index);
+    return 0;
+}
+
+// Function to decompress a page from the pool into a frame. The pool keeps
+// its copy until the page is written, so a clean eviction costs nothing.
+// Returns -1 if the copy is corrupt, in which case the page is lost: only
+// dirty pages enter the pool, so a swap slot the page still has holds an
+// older version and cannot stand in for it.
+int zswap_load(int process_id, int page_number, int frame) {
+    PageTableEntry *pte = pt_lookup(&page_tables[process_id], page_number);
+    ZswapEntry *entry = &zswap.entries[pte->zswap_entry];
+    if (lz_decompress(entry->data, entry->size, (unsigned char *)frame_data(frame), PAGE_SIZE) != PAGE_SIZE) {
+        fprintf(stderr, "Compressed copy of page %d of process %d is corrupt, the page is lost\n", page_number, process_id);
+        zswap_drop(pte);
+        if (pte->swap_slot != -1) {
+            free_swap_slot(pte->swap_slot);
+            pte->swap_slot = -1;
+        }
+        return -1;
+    }
+    zswap.loads++;
+
+    if (pager_trace_level >= TRACE_PAGES) {
+        printf("Decompressing page %d of process %d into frame %d\n", page_number, process_id, frame);
+    }
+    return 0;
+}
+
+// Function to write every page in the pool back to swap
+void zswap_flush() {
+    while (zswap.lru_tail != -1) {
+        if (zswap_writeback_oldest() != 0) {
+            fprintf(stderr, "zswap: swap is full, %ld pages stay compressed\n", zswap.stored_pages);
+            return;
+        }
+    }
+}
+
+// Function to check whether a page has a copy in the pool or on swap
+int page_swapped_out(PageTableEntry *entry) {
+    return entry != NULL && (entry->zswap_entry != -1 || entry->swap_slot != -1);
+}
+
+// Function to bring a swapped-out page into a frame from the pool or, failing
+// that, from its swap slot. Returns the tier it came from, -1 if its
+// compressed copy was corrupt.
+int swap_in_page(int process_id, int page_number, int frame) {
+    PageTableEntry *entry = pt_lookup(&page_tables[process_id], page_number);
+    if (entry->zswap_entry != -1) {
+        return zswap_load(process_id, page_number, frame) == 0 ? FAULT_TIER_ZSWAP : -1;
+    }
+    read_page_from_swap(process_id, page_number, frame);
+    return FAULT_TIER_SWAP;
+}
+
+// Function to display the compressed pool and fault latency by tier
+void show_zswap_stats() {
+    printf("Zswap: %s, pool %ld KB of %ld KB budget (%d%% of memory)\n", zswap.enabled ? "on" : "off",
+           zswap.pool_bytes / 1024, zswap_budget() / 1024, zswap.max_percent);
+    printf("  Stored pages:   %ld", zswap.stored_pages);
+    if (zswap.pool_bytes > 0) {
+        printf(" (compression ratio %.2f:1)", (double)zswap.stored_pages * PAGE_SIZE / zswap.pool_bytes);
+    }
+    printf("\n");
+    printf("  Stores:         %ld", zswap.stores);
+    if (zswap.stored_bytes > 0) {
+        printf(" (average ratio %.2f:1)", (double)zswap.stores * PAGE_SIZE / zswap.stored_bytes);
+    }
+    printf("\n");
+    printf("  Rejected:       %ld (compressed worse than %d%%)\n", zswap.rejects, ZSWAP_MAX_COMPRESSED * 100 / PAGE_SIZE);
+    printf("  Loads:          %ld\n", zswap.loads);
+    printf("  Written back:   %ld\n", zswap.writebacks);
+    printf("  Invalidated:    %ld\n", zswap.invalidates);
+    printf("Fault latency by tier:\n");
+    for (int tier = 0; tier < FAULT_TIERS; tier++) {
+        print_latency_summary(fault_tier_names[tier], &tier_latency[tier]);
+    }
+}
+
+// Function to handle the zswap builtin
+void zswap_command(char **args) {
+    if (args[1] == NULL) {
+        show_zswap_stats();
+    } else if (strcmp(args[1], "on") == 0) {
+        zswap.enabled = 1;
+    } else if (strcmp(args[1], "off") == 0) {
+        zswap.enabled = 0;
+        zswap_flush();
+    } else if (strcmp(args[1], "reset") == 0) {
+        zswap.stores = 0;
+        zswap.stored_bytes = 0;
+        zswap.rejects = 0;
+        zswap.loads = 0;
+        zswap.writebacks = 0;
+        zswap.invalidates = 0;
+        memset(tier_latency, 0, sizeof(tier_latency));
+    } else if (atoi(args[1]) > 0 && atoi(args[1]) <= 100) {
+        zswap.max_percent = atoi(args[1]);
+        zswap_shrink(-1);
+    } else {
+        fprintf(stderr, "zswap: usage: zswap [on|off|reset|<max%%>]\n");
+    }
+}
+
+// Function to check if a page is modified
+int is_page_modified(PageTable *pt, int page_number) {
+    PageTableEntry *entry = pt_lookup(pt, page_number);
+    return entry != NULL && entry->modified;
+}
+
+// Function to hash a page key
+size_t hash_page_key(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return (size_t)key;
+}
+
+// Function to initialize a page map sized for the expected number of keys
+int page_map_init(PageMap *map, size_t expected) {
+    size_t capacity = 16;
+    while (capacity < expected * 2) {
+        capacity <<= 1;
+    }
+    map->keys = malloc(capacity * sizeof(uint64_t));
+    map->values = malloc(capacity * sizeof(long));
+    map->used = calloc(capacity, 1);
+    map->capacity = capacity;
+    map->count = 0;
+    if (map->keys == NULL || map->values == NULL || map->used == NULL) {
+        perror("Error allocating page map");
+        return -1;
+    }
+    return 0;
+}
+
+// Function to free a page map
+void page_map_free(PageMap *map) {
+    free(map->keys);
+    free(map->values);
+    free(map->used);
+    map->keys = NULL;
+    map->values = NULL;
+    map->used = NULL;
+    map->capacity = 0;
+    map->count = 0;
+}
+
+// Function to remove all keys from a page map
+void page_map_clear(PageMap *map) {
+    memset(map->used, 0, map->capacity);
+    map->count = 0;
+}
+
+// Function to find the value stored for a key, NULL if the key is absent
+long *page_map_find(PageMap *map, uint64_t key) {
+    size_t mask = map->capacity - 1;
+    for (size_t i = hash_page_key(key) & mask; map->used[i]; i = (i + 1) & mask) {
+        if (map->keys[i] == key) {
+            return &map->values[i];
+        }
+    }
+    return NULL;
+}
+
+// Function to double the capacity of a page map
+void page_map_grow(PageMap *map) {
+    PageMap bigger;
+    if (page_map_init(&bigger, map->capacity) != 0) {
+        exit(1);
+    }
+    size_t mask = bigger.capacity - 1;
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (map->used[i]) {
+            size_t j = hash_page_key(map->keys[i]) & mask;
+            while (bigger.used[j]) {
+                j = (j + 1) & mask;
+            }
+            bigger.used[j] = 1;
+            bigger.keys[j] = map->keys[i];
+            bigger.values[j] = map->values[i];
+            bigger.count++;
+        }
+    }
+    page_map_free(map);
+    *map = bigger;
+}
+
+// Function to find or insert a key, returning its value slot (0 for new keys)
+long *page_map_insert(PageMap *map, uint64_t key) {
+    if ((map->count + 1) * 2 > map->capacity) {
+        page_map_grow(map);
+    }
+    size_t mask = map->capacity - 1;
+    size_t i = hash_page_key(key) & mask;
+    while (map->used[i]) {
+        if (map->keys[i] == key) {
+            return &map->values[i];
+        }
+        i = (i + 1) & mask;
+    }
+    map->used[i] = 1;
+    map->keys[i] = key;
+    map->values[i] = 0;
+    map->count++;
+    return &map->values[i];
+}
+
+// Function to remove a key, shifting later entries back to keep probe chains intact
+void page_map_remove(PageMap *map, uint64_t key) {
+    size_t mask = map->capacity - 1;
+    size_t i = hash_page_key(key) & mask;
+    while (map->used[i] && map->keys[i] != key) {
+        i = (i + 1) & mask;
+    }
+    if (!map->used[i]) {
+        return;
+    }
+
+    size_t hole = i;
+    for (size_t j = (i + 1) & mask; map->used[j]; j = (j + 1) & mask) {
+        size_t home = hash_page_key(map->keys[j]) & mask;
+        // Move the entry into the hole unless its home slot lies between the hole and j
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            map->keys[hole] = map->keys[j];
+            map->values[hole] = map->values[j];
+            hole = j;
+        }
+    }
+    map->used[hole] = 0;
+    map->count--;
+}
+
+// Function to unlink a frame from whichever replacement list it is in
+void frame_list_remove(int frame_number) {
+    LRUEntry *entry = &lru_list[frame_number];
+    FrameList *list = entry->list;
+    if (list == NULL) {
+        return;
+    }
+
+    if (entry->prev != -1) {
+        lru_list[entry->prev].next = entry->next;
+    } else {
+        list->head = entry->next;
+    }
+    if (entry->next != -1) {
+        lru_list[entry->next].prev = entry->prev;
+    } else {
+        list->tail = entry->prev;
+    }
+    entry->prev = -1;
+    entry->next = -1;
+    entry->list = NULL;
+    list->count--;
+}
+
+// Function to move a frame to the head of a replacement list
+void frame_list_push_head(FrameList *list, int frame_number) {
+    if (list->head == frame_number) {
+        return;  // Already at the head
+    }
+    frame_list_remove(frame_number);
+
+    LRUEntry *entry = &lru_list[frame_number];
+    entry->prev = -1;
+    entry->next = list->head;
+    entry->list = list;
+    if (list->head != -1) {
+        lru_list[list->head].prev = frame_number;
+    } else {
+        list->tail = frame_number;
+    }
+    list->head = frame_number;
+    list->count++;
+}
+
+// Function to empty a replacement list without touching its frames' links
+void frame_list_reset(FrameList *list) {
+    list->head = -1;
+    list->tail = -1;
+    list->count = 0;
+}
+
+// Function to unlink a frame from the LRU list
+void remove_from_lru(int frame_number) {
+    frame_list_remove(frame_number);
+}
+
+// Function to update the LRU list by moving a frame to the most recently used end
+void update_lru(int frame_number) {
+    frame_list_push_head(&lru_frames, frame_number);
+}
+
+// Function to find the least recently used (LRU) frame
+int find_lru_frame() {
+    return lru_frames.tail;  // -1 if no frame is in use
+}
+
+// Per-frame state shared by the policies that need it
+unsigned char *frame_referenced;  // Referenced bit, set on every hit like the MMU sets it; Clock, Second-Chance and aging clear it
+unsigned char *frame_age;  // Aging counter, most recent interval in the top bit
+long *frame_frequency;  // Reference count for LFU
+
+// Indexed binary min-heap over frames, used by LFU and OPT
+int *frame_heap;
+int *frame_heap_pos;  // Position in the heap plus one, 0 if not in the heap
+long *frame_heap_key;
+int frame_heap_size = 0;
+
+// Function to swap two heap slots
+void frame_heap_swap(int a, int b) {
+    int frame_a = frame_heap[a];
+    int frame_b = frame_heap[b];
+    frame_heap[a] = frame_b;
+    frame_heap[b] = frame_a;
+    frame_heap_pos[frame_b] = a + 1;
+    frame_heap_pos[frame_a] = b + 1;
+}
+
+// Function to restore the heap order from a slot towards the root
+void frame_heap_sift_up(int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (frame_heap_key[frame_heap[parent]] <= frame_heap_key[frame_heap[i]]) {
+            break;
+        }
+        frame_heap_swap(i, parent);
+        i = parent;
+    }
+}
+
+// Function to restore the heap order from a slot towards the leaves
+void frame_heap_sift_down(int i) {
+    while (1) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < frame_heap_size && frame_heap_key[frame_heap[left]] < frame_heap_key[frame_heap[smallest]]) {
+            smallest = left;
+        }
+        if (right < frame_heap_size && frame_heap_key[frame_heap[right]] < frame_heap_key[frame_heap[smallest]]) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            break;
+        }
+        frame_heap_swap(i, smallest);
+        i = smallest;
+    }
+}
+
+// Function to insert a frame into the heap or change its key
+void frame_heap_update(int frame_number, long key) {
+    frame_heap_key[frame_number] = key;
+    if (frame_heap_pos[frame_number] == 0) {
+        frame_heap[frame_heap_size] = frame_number;
+        frame_heap_pos[frame_number] = ++frame_heap_size;
+    }
+    frame_heap_sift_up(frame_heap_pos[frame_number] - 1);
+    frame_heap_sift_down(frame_heap_pos[frame_number] - 1);
+}
+
+// Function to remove a frame from the heap
+void frame_heap_remove(int frame_number) {
+    int i = frame_heap_pos[frame_number] - 1;
+    if (i < 0) {
+        return;
+    }
+    frame_heap_swap(i, --frame_heap_size);
+    frame_heap_pos[frame_number] = 0;
+    if (i < frame_heap_size) {
+        frame_heap_sift_up(i);
+        frame_heap_sift_down(i);
+    }
+}
+
+// Function to empty the heap
+void frame_heap_reset() {
+    for (int i = 0; i < frame_heap_size; i++) {
+        frame_heap_pos[frame_heap[i]] = 0;
+    }
+    frame_heap_size = 0;
+}
+
+// Structure representing an entry in a ghost list, which remembers recently
+// evicted pages (ARC and 2Q) without holding a frame
+typedef struct {
+    uint64_t key;  // Page key of the evicted page
+    int prev;
+    int next;
+    struct GhostList *list;  // List the entry belongs to, NULL if unused
+} GhostEntry;
+
+// Structure representing a ghost list ordered from newest (head) to oldest (tail)
+typedef struct GhostList {
+    int head;
+    int tail;
+    int count;
+} GhostList;
+
+// Pool of ghost entries and an index from page keys to entries
+GhostEntry *ghost_entries;  // num_frames + 1 entries
+int ghost_free_head = -1;
+int ghost_next_unused = 0;
+PageMap ghost_index;
+
+// Function to allocate the per-frame state of the replacement policies
+void init_policy_state() {
+    frame_referenced = allocate_frame_array(sizeof(unsigned char), num_frames);
+    frame_age = allocate_frame_array(sizeof(unsigned char), num_frames);
+    frame_frequency = allocate_frame_array(sizeof(long), num_frames);
+    frame_heap = allocate_frame_array(sizeof(int), num_frames);
+    frame_heap_pos = allocate_frame_array(sizeof(int), num_frames);
+    frame_heap_key = allocate_frame_array(sizeof(long), num_frames);
+    ghost_entries = allocate_frame_array(sizeof(GhostEntry), num_frames + 1);
+}
+
+// Function to reset all ghost lists
+void ghost_reset() {
+    ghost_free_head = -1;
+    ghost_next_unused = 0;
+    if (ghost_index.capacity == 0) {
+        page_map_init(&ghost_index, num_frames);
+    } else {
+        page_map_clear(&ghost_index);
+    }
+}
+
+// Function to find the ghost entry for a page in a given list, -1 if absent
+int ghost_lookup(GhostList *list, uint64_t key) {
+    long *slot = page_map_find(&ghost_index, key);
+    if (slot == NULL || ghost_entries[*slot].list != list) {
+        return -1;
+    }
+    return (int)*slot;
+}
+
+// Function to remove a ghost entry and return it to the pool
+void ghost_remove(int index) {
+    GhostEntry *entry = &ghost_entries[index];
+    GhostList *list = entry->list;
+    if (entry->prev != -1) {
+        ghost_entries[entry->prev].next = entry->next;
+    } else {
+        list->head = entry->next;
+    }
+    if (entry->next != -1) {
+        ghost_entries[entry->next].prev = entry->prev;
+    } else {
+        list->tail = entry->prev;
+    }
+    list->count--;
+    page_map_remove(&ghost_index, entry->key);
+    entry->list = NULL;
+    entry->next = ghost_free_head;
+    ghost_free_head = index;
+}
+
+// Function to remember an evicted page at the head of a ghost list
+void ghost_push_head(GhostList *list, uint64_t key) {
+    long *slot = page_map_find(&ghost_index, key);
+    if (slot != NULL) {
+        ghost_remove((int)*slot);  // A page is remembered in at most one list
+    }
+
+    int index;
+    if (ghost_free_head != -1) {
+        index = ghost_free_head;
+        ghost_free_head = ghost_entries[index].next;
+    } else if (ghost_next_unused <= num_frames) {
+        index = ghost_next_unused++;
+    } else {
+        return;  // Pool exhausted, forget the page
+    }
+
+    GhostEntry *entry = &ghost_entries[index];
+    entry->key = key;
+    entry->prev = -1;
+    entry->next = list->head;
+    entry->list = list;
+    if (list->head != -1) {
+        ghost_entries[list->head].prev = index;
+    } else {
+        list->tail = index;
+    }
+    list->head = index;
+    list->count++;
+    *page_map_insert(&ghost_index, key) = index;
+}
+
+// Function to forget the oldest page in a ghost list
+void ghost_drop_tail(GhostList *list) {
+    if (list->tail != -1) {
+        ghost_remove(list->tail);
+    }
+}
+
+// Function to get the page key of the page held by a frame
+uint64_t frame_page_key(int frame_number) {
+    return PAGE_KEY(frame_table[frame_number].process_id, frame_table[frame_number].page_number);
+}
+
+// Policy callback that does nothing, for events a policy does not care about
+void policy_ignore_fault(int process_id, int page_number) {
+    (void)process_id;
+    (void)page_number;
+}
+
+// Policy callback that does nothing on a hit
+void policy_ignore_access(int frame_number) {
+    (void)frame_number;
+}
+
+// Policy callback that unlinks the frame from its replacement list
+void policy_unlink_frame(int frame_number, int evicted) {
+    (void)evicted;
+    frame_list_remove(frame_number);
+}
+
+// LRU: evict the page that has gone unreferenced for the longest time
+void lru_init() {
+    frame_list_reset(&lru_frames);
+}
+
+// FIFO: evict the page that was loaded earliest, ignoring later references
+FrameList fifo_frames = {-1, -1, 0};
+
+void fifo_init() {
+    frame_list_reset(&fifo_frames);
+}
+
+void fifo_on_load(int frame_number) {
+    frame_list_push_head(&fifo_frames, frame_number);
+}
+
+int fifo_select_victim() {
+    return fifo_frames.tail;
+}
+
+// Clock: sweep a hand over the frames, giving referenced pages a second chance
+int clock_hand = 0;
+
+void clock_init() {
+    clock_hand = 0;
+}
+
+void clock_on_reference(int frame_number) {
+    frame_referenced[frame_number] = 1;
+}
+
+int clock_select_victim() {
+    for (long scanned = 0; scanned <= 2L * num_frames; scanned++) {
+        int frame = clock_hand;
+        clock_hand = (clock_hand + 1) % num_frames;
+        if (!frame_holds_page(frame)) {
+            continue;
+        }
+        if (frame_referenced[frame]) {
+            frame_referenced[frame] = 0;
+            continue;
+        }
+        return frame;
+    }
+    return -1;
+}
+
+void clock_on_remove(int frame_number, int evicted) {
+    (void)evicted;
+    frame_referenced[frame_number] = 0;
+}
+
+// Second-Chance: FIFO order, but a referenced page at the tail is requeued instead of evicted
+FrameList second_chance_frames = {-1, -1, 0};
+
+void second_chance_init() {
+    frame_list_reset(&second_chance_frames);
+}
+
+void second_chance_on_load(int frame_number) {
+    frame_referenced[frame_number] = 1;
+    frame_list_push_head(&second_chance_frames, frame_number);
+}
+
+int second_chance_select_victim() {
+    while (second_chance_frames.tail != -1) {
+        int frame = second_chance_frames.tail;
+        if (!frame_referenced[frame]) {
+            return frame;
+        }
+        frame_referenced[frame] = 0;
+        frame_list_push_head(&second_chance_frames, frame);
+    }
+    return -1;
+}
+
+void second_chance_on_remove(int frame_number, int evicted) {
+    frame_referenced[frame_number] = 0;
+    policy_unlink_frame(frame_number, evicted);
+}
+
+// Aging: shift each frame's reference bit into an 8-bit counter once per
+// interval and evict the frame with the smallest counter. The interval is at
+// least the number of resident frames, so the periodic sweep costs O(1) per
+// reference; picking a victim scans the resident frames.
+FrameList aging_frames = {-1, -1, 0};
+long aging_references = 0;
+
+void aging_init() {
+    frame_list_reset(&aging_frames);
+    aging_references = 0;
+}
+
+void aging_tick() {
+    for (int frame = aging_frames.head; frame != -1; frame = lru_list[frame].next) {
+        frame_age[frame] = (unsigned char)((frame_age[frame] >> 1) | (frame_referenced[frame] << 7));
+        frame_referenced[frame] = 0;
+    }
+    aging_references = 0;
+}
+
+void aging_on_access(int frame_number) {
+    (void)frame_number;  // The referenced bit is already set
+    long interval = aging_frames.count > AGING_MIN_INTERVAL ? aging_frames.count : AGING_MIN_INTERVAL;
+    if (++aging_references >= interval) {
+        aging_tick();
+    }
+}
+
+void aging_on_load(int frame_number) {
+    frame_age[frame_number] = 0;
+    frame_referenced[frame_number] = 1;
+    frame_list_push_head(&aging_frames, frame_number);
+    aging_on_access(frame_number);
+}
+
+int aging_select_victim() {
+    // Walk from the oldest load so that ties go to the page loaded first
+    int victim = aging_frames.tail;
+    for (int frame = aging_frames.tail; frame != -1; frame = lru_list[frame].prev) {
+        if (frame_age[frame] < frame_age[victim] ||
+            (frame_age[frame] == frame_age[victim] && frame_referenced[frame] < frame_referenced[victim])) {
+            victim = frame;
+        }
+    }
+    return victim;
+}
+
+void aging_on_remove(int frame_number, int evicted) {
+    frame_referenced[frame_number] = 0;
+    frame_age[frame_number] = 0;
+    policy_unlink_frame(frame_number, evicted);
+}
+
+// LFU: evict the least frequently referenced page, least recently used among ties
+#define LFU_MAX_FREQUENCY ((1L << 22) - 1)
+
+void lfu_init() {
+    frame_heap_reset();
+}
+
+void lfu_on_access(int frame_number) {
+    if (frame_frequency[frame_number] < LFU_MAX_FREQUENCY) {
+        frame_frequency[frame_number]++;
+    }
+    // Frequency in the high bits, recency in the low bits
+    frame_heap_update(frame_number, (frame_frequency[frame_number] << 40) | (policy_clock & ((1L << 40) - 1)));
+}
+
+void lfu_on_load(int frame_number) {
+    frame_frequency[frame_number] = 0;
+    lfu_on_access(frame_number);
+}
+
+int lfu_select_victim() {
+    return frame_heap_size > 0 ? frame_heap[0] : -1;
+}
+
+void lfu_on_remove(int frame_number, int evicted) {
+    (void)evicted;
+    frame_heap_remove(frame_number);
+}
+
+// ARC: balance a recency list (T1) against a frequency list (T2), adapting
+// the target size of T1 from hits in the ghost lists of recently evicted pages
+FrameList arc_t1 = {-1, -1, 0};
+FrameList arc_t2 = {-1, -1, 0};
+GhostList arc_b1 = {-1, -1, 0};
+GhostList arc_b2 = {-1, -1, 0};
+int arc_target = 0;  // Target size of T1
+int arc_pending = 0;  // Ghost list that held the faulting page: 0 none, 1 B1, 2 B2
+
+void arc_init() {
+    frame_list_reset(&arc_t1);
+    frame_list_reset(&arc_t2);
+    arc_b1 = (GhostList){-1, -1, 0};
+    arc_b2 = (GhostList){-1, -1, 0};
+    ghost_reset();
+    arc_target = 0;
+    arc_pending = 0;
+}
+
+void arc_on_fault(int process_id, int page_number) {
+    uint64_t key = PAGE_KEY(process_id, page_number);
+    int ghost;
+    arc_pending = 0;
+    if ((ghost = ghost_lookup(&arc_b1, key)) != -1) {
+        int delta = arc_b1.count >= arc_b2.count ? 1 : arc_b2.count / arc_b1.count;
+        arc_target = arc_target + delta > num_frames ? num_frames : arc_target + delta;
+        ghost_remove(ghost);
+        arc_pending = 1;
+    } else if ((ghost = ghost_lookup(&arc_b2, key)) != -1) {
+        int delta = arc_b2.count >= arc_b1.count ? 1 : arc_b1.count / arc_b2.count;
+        arc_target = arc_target - delta < 0 ? 0 : arc_target - delta;
+        ghost_remove(ghost);
+        arc_pending = 2;
+    }
+}
+
+int arc_select_victim() {
+    if (arc_t1.count > 0 &&
+        (arc_t2.count == 0 || arc_t1.count > arc_target || (arc_pending == 2 && arc_t1.count == arc_target))) {
+        return arc_t1.tail;
+    }
+    return arc_t2.tail;
+}
+
+void arc_on_load(int frame_number) {
+    frame_list_push_head(arc_pending ? &arc_t2 : &arc_t1, frame_number);
+    arc_pending = 0;
+}
+
+void arc_on_access(int frame_number) {
+    frame_list_push_head(&arc_t2, frame_number);
+}
+
+void arc_on_remove(int frame_number, int evicted) {
+    FrameList *list = lru_list[frame_number].list;
+    frame_list_remove(frame_number);
+    if (!evicted) {
+        return;
+    }
+
+    ghost_push_head(list == &arc_t1 ? &arc_b1 : &arc_b2, frame_page_key(frame_number));
+    // Keep |T1| + |B1| <= c and the whole directory within 2c
+    while (arc_t1.count + arc_b1.count > num_frames) {
+        ghost_drop_tail(&arc_b1);
+    }
+    while (arc_t1.count + arc_t2.count + arc_b1.count + arc_b2.count > 2 * num_frames) {
+        ghost_drop_tail(&arc_b2);
+    }
+}
+
+// 2Q: new pages enter a FIFO (A1in); pages referenced again after leaving it,
+// as remembered by the A1out ghost list, are promoted to an LRU list (Am)
+FrameList twoq_a1in = {-1, -1, 0};
+FrameList twoq_am = {-1, -1, 0};
+GhostList twoq_a1out = {-1, -1, 0};
+int twoq_pending = 0;  // 1 if the faulting page was found in A1out
+
+#define TWOQ_KIN (num_frames / 4 > 0 ? num_frames / 4 : 1)  // Target size of A1in
+#define TWOQ_KOUT (num_frames / 2 > 0 ? num_frames / 2 : 1)  // Size of A1out
+
+void twoq_init() {
+    frame_list_reset(&twoq_a1in);
+    frame_list_reset(&twoq_am);
+    twoq_a1out = (GhostList){-1, -1, 0};
+    ghost_reset();
+    twoq_pending = 0;
+}
+
+void twoq_on_fault(int process_id, int page_number) {
+    int ghost = ghost_lookup(&twoq_a1out, PAGE_KEY(process_id, page_number));
+    twoq_pending = ghost != -1;
+    if (ghost != -1) {
+        ghost_remove(ghost);
+    }
+}
+
+int twoq_select_victim() {
+    if (twoq_a1in.count > TWOQ_KIN || twoq_am.count == 0) {
+        return twoq_a1in.tail;
+    }
+    return twoq_am.tail;
+}
+
+void twoq_on_load(int frame_number) {
+    frame_list_push_head(twoq_pending ? &twoq_am : &twoq_a1in, frame_number);
+    twoq_pending = 0;
+}
+
+void twoq_on_access(int frame_number) {
+    if (lru_list[frame_number].list == &twoq_am) {
+        frame_list_push_head(&twoq_am, frame_number);
+    }
+}
+
+void twoq_on_remove(int frame_number, int evicted) {
+    FrameList *list = lru_list[frame_number].list;
+    frame_list_remove(frame_number);
+    if (evicted && list == &twoq_a1in) {
+        ghost_push_head(&twoq_a1out, frame_page_key(frame_number));
+        while (twoq_a1out.count > TWOQ_KOUT) {
+            ghost_drop_tail(&twoq_a1out);
+        }
+    }
+}
+
+// OPT (Belady): evict the page whose next reference is furthest in the future.
+// Needs the whole reference string up front, see set_reference_string().
+void opt_init() {
+    frame_heap_reset();
+}
+
+void opt_on_access(int frame_number) {
+    long next_use = LONG_MAX;  // Never referenced again, or no reference string
+    long position = policy_clock - opt_start;
+    if (position >= 0 && position < opt_length) {
+        next_use = opt_next_use[position];
+    }
+    frame_heap_update(frame_number, -next_use);  // Min-heap, so the furthest use is on top
+}
+
+int opt_select_victim() {
+    return frame_heap_size > 0 ? frame_heap[0] : -1;
+}
+
+void opt_on_remove(int frame_number, int evicted) {
+    (void)evicted;
+    frame_heap_remove(frame_number);
+}
+
+// Table of available replacement policies
+ReplacementPolicy policies[] = {
+    {"lru", lru_init, policy_ignore_fault, find_lru_frame, update_lru, update_lru, policy_unlink_frame, 0, 0, 0},
+    {"fifo", fifo_init, policy_ignore_fault, fifo_select_victim, fifo_on_load, policy_ignore_access, policy_unlink_frame, 0, 0, 0},
+    {"clock", clock_init, policy_ignore_fault, clock_select_victim, clock_on_reference, policy_ignore_access, clock_on_remove, 0, 0, 0},
+    {"second-chance", second_chance_init, policy_ignore_fault, second_chance_select_victim, second_chance_on_load, policy_ignore_access, second_chance_on_remove, 0, 0, 0},
+    {"aging", aging_init, policy_ignore_fault, aging_select_victim, aging_on_load, aging_on_access, aging_on_remove, 0, 0, 0},
+    {"lfu", lfu_init, policy_ignore_fault, lfu_select_victim, lfu_on_load, lfu_on_access, lfu_on_remove, 0, 0, 0},
+    {"arc", arc_init, arc_on_fault, arc_select_victim, arc_on_load, arc_on_access, arc_on_remove, 0, 0, 0},
+    {"2q", twoq_init, twoq_on_fault, twoq_select_victim, twoq_on_load, twoq_on_access, twoq_on_remove, 0, 0, 0},
+    {"opt", opt_init, policy_ignore_fault, opt_select_victim, opt_on_access, opt_on_access, opt_on_remove, 0, 0, 0},
+};
+#define NUM_POLICIES ((int)(sizeof(policies) / sizeof(policies[0])))
+
+ReplacementPolicy *current_policy = &policies[0];
+
+// Function to select the replacement policy by name. Resident frames are
+// handed to the new policy in frame order.
+int set_replacement_policy(const char *name) {
+    ReplacementPolicy *policy = NULL;
+    for (int i = 0; i < NUM_POLICIES; i++) {
+        if (strcmp(policies[i].name, name) == 0) {
+            policy = &policies[i];
+        }
+    }
+    if (policy == NULL) {
+        return -1;
+    }
+
+    // Drop the old policy's state. Only the frames in the owner lists hold
+    // pages, so the switch costs O(resident pages) whatever the memory size.
+    for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+        for (int frame = process_frame_head[process_id]; frame != -1; frame = frame_table[frame].owner_next) {
+            current_policy->on_remove(frame, 0);
+        }
+    }
+    current_policy = policy;
+    current_policy->init();
+    for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+        for (int frame = process_frame_head[process_id]; frame != -1; frame = frame_table[frame].owner_next) {
+            current_policy->on_load(frame);
+        }
+    }
+    if (strcmp(policy->name, "opt") == 0 && opt_length == 0) {
+        printf("policy: opt needs the future reference string and is only exact under simulate\n");
+    }
+    return 0;
+}
+
+// Function to install the reference string used by the OPT policy. Position i
+// of the string is the ith page reference from now on.
+void set_reference_string(const uint64_t *keys, long length) {
+    free(opt_next_use);
+    opt_next_use = NULL;
+    opt_length = 0;
+    if (length == 0) {
+        return;
+    }
+
+    opt_next_use = malloc(length * sizeof(long));
+    PageMap next_seen;
+    if (opt_next_use == NULL || page_map_init(&next_seen, 1024) != 0) {
+        perror("Error allocating reference string");
+        free(opt_next_use);
+        opt_next_use = NULL;
+        return;
+    }
+
+    // Walk backwards, remembering where each page is referenced next
+    for (long i = length - 1; i >= 0; i--) {
+        long *next = page_map_insert(&next_seen, keys[i]);
+        opt_next_use[i] = *next ? *next - 1 : LONG_MAX;
+        *next = i + 1;  // Stored plus one so that 0 means not seen yet
+    }
+    page_map_free(&next_seen);
+    opt_start = policy_clock;
+    opt_length = length;
+}
+
+// Function to reset the hit and fault counters of every policy
+void reset_policy_stats() {
+    for (int i = 0; i < NUM_POLICIES; i++) {
+        policies[i].hits = 0;
+        policies[i].faults = 0;
+        policies[i].evictions = 0;
+    }
+}
+
+// Function to display the hit and fault counters of every policy
+void show_policy_stats() {
+    printf("  %-14s %12s %12s %12s %9s\n", "Policy", "Hits", "Faults", "Evictions", "Hit rate");
+    for (int i = 0; i < NUM_POLICIES; i++) {
+        ReplacementPolicy *policy = &policies[i];
+        long references = policy->hits + policy->faults;
+        printf("%c %-14s %12ld %12ld %12ld %8.2f%%\n", policy == current_policy ? '*' : ' ', policy->name,
+               policy->hits, policy->faults, policy->evictions,
+               references ? 100.0 * policy->hits / references : 0.0);
+    }
+}
+
+// Structure representing an entry in the simulated TLB
+typedef struct {
+    int valid;
+    int asid;  // Address-space ID, the process ID of the translation
+    int page_number;
+    int frame_number;
+    long last_used;  // For LRU replacement within a set
+} TLBEntry;
+
+// Structure representing a set-associative TLB in front of the page tables
+typedef struct {
+    TLBEntry entries[TLB_MAX_ENTRIES];
+    TLBEntry huge_entries[TLB_HUGE_ENTRIES];  // Huge page translations; page and frame are the first of the 2 MB
+    int num_entries;
+    int ways;  // Entries per set
+    int num_sets;
+    int enabled;
+    long clock;
+    long hits;
+    long huge_hits;  // Hits on huge page entries
+    long misses;
+    long walks;  // Page-table walks after a miss
+    long walk_references;  // Page-table levels read by those walks
+    long shootdowns;  // Single entries invalidated because a page was unmapped
+    long flushes;  // Address spaces flushed when a process terminated
+} TLB;
+
+TLB tlb = {.num_entries = TLB_DEFAULT_ENTRIES, .ways = TLB_DEFAULT_WAYS,
+           .num_sets = TLB_DEFAULT_ENTRIES / TLB_DEFAULT_WAYS, .enabled = 1};
+
+// Function to get the first entry of the set a page maps to
+TLBEntry *tlb_set(int page_number) {
+    return &tlb.entries[(page_number % tlb.num_sets) * tlb.ways];
+}
+
+// Function to resize the TLB, which also empties it
+int tlb_configure(int num_entries, int ways) {
+    if (num_entries <= 0 || num_entries > TLB_MAX_ENTRIES || ways <= 0 || num_entries % ways != 0) {
+        return -1;
+    }
+    memset(tlb.entries, 0, sizeof(tlb.entries));
+    memset(tlb.huge_entries, 0, sizeof(tlb.huge_entries));
+    tlb.num_entries = num_entries;
+    tlb.ways = ways;
+    tlb.num_sets = num_entries / ways;
+    return 0;
+}
+
+// Function to translate a page through the TLB, -1 on a miss
+int tlb_lookup(int asid, int page_number) {
+    TLBEntry *set = tlb_set(page_number);
+    for (int way = 0; way < tlb.ways; way++) {
+        if (set[way].valid && set[way].asid == asid && set[way].page_number == page_number) {
+            set[way].last_used = ++tlb.clock;
+            tlb.hits++;
+            return set[way].frame_number;
+        }
+    }
+    int first_page = page_number & ~(HUGE_PAGE_FRAMES - 1);
+    for (int i = 0; huge_pages.mapped > 0 && i < TLB_HUGE_ENTRIES; i++) {  // Without huge pages a miss is final
+        TLBEntry *entry = &tlb.huge_entries[i];
+        if (entry->valid && entry->asid == asid && entry->page_number == first_page) {
+            entry->last_used = ++tlb.clock;
+            tlb.hits++;
+            tlb.huge_hits++;
+            return entry->frame_number + (page_number - first_page);
+        }
+    }
+    tlb.misses++;
+    return -1;
+}
+
+// Function to cache a translation, replacing the least recently used entry of its set
+void tlb_insert(int asid, int page_number, int frame_number) {
+    TLBEntry *set = tlb_set(page_number);
+    TLBEntry *victim = &set[0];
+    for (int way = 0; way < tlb.ways; way++) {
+        if (!set[way].valid) {
+            victim = &set[way];
+            break;
+        }
+        if (set[way].last_used < victim->last_used) {
+            victim = &set[way];
+        }
+    }
+    victim->valid = 1;
+    victim->asid = asid;
+    victim->page_number = page_number;
+    victim->frame_number = frame_number;
+    victim->last_used = ++tlb.clock;
+}
+
+// Function to cache the translation of a huge page, replacing the least recently used huge entry
+void tlb_insert_huge(int asid, int first_page, int first_frame) {
+    TLBEntry *victim = &tlb.huge_entries[0];
+    for (int i = 0; i < TLB_HUGE_ENTRIES; i++) {
+        if (!tlb.huge_entries[i].valid) {
+            victim = &tlb.huge_entries[i];
+            break;
+        }
+        if (tlb.huge_entries[i].last_used < victim->last_used) {
+            victim = &tlb.huge_entries[i];
+        }
+    }
+    victim->valid = 1;
+    victim->asid = asid;
+    victim->page_number = first_page;
+    victim->frame_number = first_frame;
+    victim->last_used = ++tlb.clock;
+}
+
+// Function to invalidate the translation of a page that is being unmapped,
+// including the huge page entry covering it
+void tlb_shootdown(int asid, int page_number) {
+    TLBEntry *set = tlb_set(page_number);
+    for (int way = 0; way < tlb.ways; way++) {
+        if (set[way].valid && set[way].asid == asid && set[way].page_number == page_number) {
+            set[way].valid = 0;
+            tlb.shootdowns++;
+        }
+    }
+    int first_page = page_number & ~(HUGE_PAGE_FRAMES - 1);
+    for (int i = 0; i < TLB_HUGE_ENTRIES; i++) {
+        TLBEntry *entry = &tlb.huge_entries[i];
+        if (entry->valid && entry->asid == asid && entry->page_number == first_page) {
+            entry->valid = 0;
+            tlb.shootdowns++;
+        }
+    }
+}
+
+// Function to invalidate every translation of an address space
+void tlb_flush_asid(int asid) {
+    for (int i = 0; i < tlb.num_entries; i++) {
+        if (tlb.entries[i].asid == asid) {
+            tlb.entries[i].valid = 0;
+        }
+    }
+    for (int i = 0; i < TLB_HUGE_ENTRIES; i++) {
+        if (tlb.huge_entries[i].asid == asid) {
+            tlb.huge_entries[i].valid = 0;
+        }
+    }
+    tlb.flushes++;
+}
+
+// Function to reset the TLB counters
+void reset_tlb_stats() {
+    tlb.hits = 0;
+    tlb.huge_hits = 0;
+    tlb.misses = 0;
+    tlb.walks = 0;
+    tlb.walk_references = 0;
+    tlb.shootdowns = 0;
+    tlb.flushes = 0;
+}
+
+// Function to get the memory covered by the valid TLB entries, in KB
+long tlb_reach_kb(int *small_entries, int *huge_entries) {
+    *small_entries = 0;
+    *huge_entries = 0;
+    for (int i = 0; i < tlb.num_entries; i++) {
+        *small_entries += tlb.entries[i].valid;
+    }
+    for (int i = 0; i < TLB_HUGE_ENTRIES; i++) {
+        *huge_entries += tlb.huge_entries[i].valid;
+    }
+    return ((long)*small_entries + (long)*huge_entries * HUGE_PAGE_FRAMES) * PAGE_SIZE / 1024;
+}
+
+// Function to display the TLB configuration and counters
+void show_tlb_stats() {
+    long lookups = tlb.hits + tlb.misses;
+    int small_entries, huge_entries;
+    long reach = tlb_reach_kb(&small_entries, &huge_entries);
+    printf("TLB: %s, %d entries, %d-way, %d sets, %d huge page entries\n", tlb.enabled ? "on" : "off", tlb.num_entries,
+           tlb.ways, tlb.num_sets, TLB_HUGE_ENTRIES);
+    printf("  Lookups:         %ld\n", lookups);
+    printf("  Hits:            %ld (%.2f%%), %ld on huge pages\n", tlb.hits, lookups ? 100.0 * tlb.hits / lookups : 0.0,
+           tlb.huge_hits);
+    printf("  Misses:          %ld\n", tlb.misses);
+    printf("  Page walks:      %ld (%ld page-table reads)\n", tlb.walks, tlb.walk_references);
+    printf("  Shootdowns:      %ld\n", tlb.shootdowns);
+    printf("  ASID flushes:    %ld\n", tlb.flushes);
+    printf("  Reach:           %ld KB (%d 4 KB and %d 2 MB entries in use)\n", reach, small_entries, huge_entries);
+}
+
+// Function to handle the tlb builtin
+void tlb_command(char **args) {
+    if (args[1] == NULL) {
+        show_tlb_stats();
+    } else if (strcmp(args[1], "on") == 0 || strcmp(args[1], "off") == 0) {
+        tlb.enabled = strcmp(args[1], "on") == 0;
+        tlb_configure(tlb.num_entries, tlb.ways);  // Start from an empty TLB either way
+    } else if (strcmp(args[1], "reset") == 0) {
+        reset_tlb_stats();
+    } else if (args[2] == NULL || tlb_configure(atoi(args[1]), atoi(args[2])) != 0) {
+        fprintf(stderr, "tlb: usage: tlb [on|off|reset|<entries> <ways>], at most %d entries\n", TLB_MAX_ENTRIES);
+    }
+}
+
+// Function to get the current time in seconds
+double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Function to get the current time in nanoseconds
+long now_nanoseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Function to map a latency to a histogram bucket. Buckets are log-linear:
+// each power of two is split into LATENCY_SUB_BUCKETS equal steps.
+int latency_bucket(long nanoseconds) {
+    if (nanoseconds < LATENCY_SUB_BUCKETS) {
+        return nanoseconds < 0 ? 0 : (int)nanoseconds;
+    }
+    int exponent = 63 - __builtin_clzl(nanoseconds);  // floor(log2)
+    int shift = exponent - LATENCY_SUB_BITS;
+    int bucket = (shift + 1) * LATENCY_SUB_BUCKETS + (int)((nanoseconds >> shift) - LATENCY_SUB_BUCKETS);
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+// Function to get the smallest latency that falls into a bucket
+long latency_bucket_floor(int bucket) {
+    if (bucket < LATENCY_SUB_BUCKETS) {
+        return bucket;
+    }
+    int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    return (long)(LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << shift;
+}
+
+// Function to record a latency in a histogram
+void record_latency(LatencyHistogram *histogram, long nanoseconds) {
+    histogram->buckets[latency_bucket(nanoseconds)]++;
+    histogram->count++;
+    histogram->total_ns += nanoseconds;
+}
+
+// Function to estimate a percentile (0-100) of a histogram, in nanoseconds
+long latency_percentile(LatencyHistogram *histogram, double percentile) {
+    long target = (long)(histogram->count * percentile / 100.0);
+    long seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        seen += histogram->buckets[bucket];
+        if (seen > target) {
+            return latency_bucket_floor(bucket);
+        }
+    }
+    return 0;
+}
+
+// Function to print the count, mean and percentiles of a histogram on one line
+void print_latency_summary(const char *label, LatencyHistogram *histogram) {
+    printf("  %-16s %10ld  mean %8.2f us  p50 %8.2f us  p90 %8.2f us  p99 %8.2f us  p99.9 %8.2f us\n", label,
+           histogram->count, histogram->count ? histogram->total_ns / 1000.0 / histogram->count : 0.0,
+           latency_percentile(histogram, 50) / 1000.0, latency_percentile(histogram, 90) / 1000.0,
+           latency_percentile(histogram, 99) / 1000.0, latency_percentile(histogram, 99.9) / 1000.0);
+}
+
+// Function to get the fraction of free memory that sits in blocks too small
+// for an allocation of the given order
+double unusable_free_index(int order) {
+    if (free_frame_count == 0) {
+        return 1.0;
+    }
+    long usable = 0;
+    for (int k = order; k < BUDDY_ORDERS; k++) {
+        usable += (long)buddy.free_blocks[k] << k;
+    }
+    return (double)(free_frame_count - usable) / free_frame_count;
+}
+
+// Function to get the fragmentation index of an order. When an allocation of
+// that order would fail, values near 0 blame a lack of free memory and values
+// near 1 blame fragmentation. Returns -1 if the allocation would succeed.
+double fragmentation_index(int order) {
+    long blocks = 0;
+    for (int k = 0; k < BUDDY_ORDERS; k++) {
+        if (k >= order && buddy.free_blocks[k] > 0) {
+            return -1.0;
+        }
+        blocks += buddy.free_blocks[k];
+    }
+    if (blocks == 0) {
+        return 0.0;
+    }
+    return 1.0 - (1.0 + (double)free_frame_count / (1 << order)) / blocks;
+}
+
+// Function to display the free lists and fragmentation of every order
+void show_buddy_stats() {
+    printf("Buddy allocator: %d frames free, %d used, %d of them by the shell\n", free_frame_count, used_frame_count,
+           buddy.shell_frames);
+    printf("  Allocations: %ld  Failures: %ld  Splits: %ld  Merges: %ld\n", buddy.allocations, buddy.failures, buddy.splits,
+           buddy.merges);
+    printf("  %5s %9s %11s %9s %10s\n", "Order", "Block", "Free blocks", "Unusable", "Frag index");
+    for (int order = 0; order < BUDDY_ORDERS; order++) {
+        printf("  %5d %6ld KB %11d %9.3f", order, ((long)PAGE_SIZE << order) / 1024, buddy.free_blocks[order],
+               unusable_free_index(order));
+        if (fragmentation_index(order) < 0) {
+            printf(" %10s\n", "-");
+        } else {
+            printf(" %10.3f\n", fragmentation_index(order));
+        }
+    }
+}
+
+// Function to stress the buddy allocator with random allocations and frees of
+// blocks up to max_order, holding at most percent of the free frames at a
+// time. Reports the latency of each operation and how fragmentation develops.
+void buddy_benchmark(long operations, int max_order, int percent) {
+    int capacity = (int)((long)free_frame_count * percent / 100);
+    int *blocks = malloc(capacity * sizeof(int));
+    char *orders = malloc(capacity);
+    if (blocks == NULL || orders == NULL) {
+        perror("Error allocating benchmark state");
+        free(blocks);
+        free(orders);
+        return;
+    }
+    LatencyHistogram *allocate_latency = calloc(2, sizeof(LatencyHistogram));
+    if (allocate_latency == NULL) {
+        perror("Error allocating benchmark state");
+        free(blocks);
+        free(orders);
+        return;
+    }
+    LatencyHistogram *free_latency = &allocate_latency[1];
+
+    int count = 0;
+    int held = 0;
+    long failures = 0;
+    printf("Buddy benchmark: %ld operations, orders 0-%d, holding up to %d frames\n", operations, max_order, capacity);
+    printf("  %12s %12s %18s %18s\n", "Operations", "Frames held", "Unusable (2 MB)", "Frag index (2 MB)");
+    for (long op = 1; op <= operations; op++) {
+        // Small blocks are the most common, each order half as likely as the one below
+        int order = 0;
+        while (order < max_order && rand() % 2) {
+            order++;
+        }
+        // Allocations outnumber frees three to two, so the held frames climb to the cap and stay near it
+        if (count > 0 && (rand() % 5 < 2 || held + (1 << order) > capacity)) {
+            int victim = rand() % count;
+            long start = now_nanoseconds();
+            buddy_free(blocks[victim], orders[victim]);
+            record_latency(free_latency, now_nanoseconds() - start);
+            held -= 1 << orders[victim];
+            buddy.shell_frames -= 1 << orders[victim];
+            count--;
+            blocks[victim] = blocks[count];
+            orders[victim] = orders[count];
+        } else if (held + (1 << order) <= capacity) {
+            long start = now_nanoseconds();
+            int frame = buddy_allocate(order);
+            record_latency(allocate_latency, now_nanoseconds() - start);
+            if (frame == -1) {
+                failures++;
+            } else {
+                blocks[count] = frame;
+                orders[count++] = order;
+                held += 1 << order;
+                buddy.shell_frames += 1 << order;
+            }
+        }
+        if (op % (operations / 10 > 0 ? operations / 10 : 1) == 0) {
+            double index = fragmentation_index(HUGE_PAGE_ORDER);
+            printf("  %12ld %12d %18.3f ", op, held, unusable_free_index(HUGE_PAGE_ORDER));
+            if (index < 0) {
+                printf("%18s\n", "-");
+            } else {
+                printf("%18.3f\n", index);
+            }
+        }
+    }
+
+    print_latency_summary("Allocate", allocate_latency);
+    print_latency_summary("Free", free_latency);
+    printf("  Failed allocations: %ld\n", failures);
+    while (count > 0) {
+        count--;
+        buddy_free(blocks[count], orders[count]);
+        buddy.shell_frames -= 1 << orders[count];
+    }
+    free(blocks);
+    free(orders);
+    free(allocate_latency);
+}
+
+// Function to handle the buddy builtin
+void buddy_command(char **args) {
+    if (args[1] == NULL) {
+        show_buddy_stats();
+    } else if (strcmp(args[1], "reset") == 0) {
+        buddy.allocations = 0;
+        buddy.failures = 0;
+        buddy.splits = 0;
+        buddy.merges = 0;
+    } else if (strcmp(args[1], "bench") == 0 && args[2] != NULL && atol(args[2]) > 0) {
+        int max_order = args[3] != NULL ? atoi(args[3]) : HUGE_PAGE_ORDER;
+        int percent = args[3] != NULL && args[4] != NULL ? atoi(args[4]) : BUDDY_BENCH_DEFAULT_PERCENT;
+        if (max_order < 0 || max_order >= BUDDY_ORDERS || percent < 1 || percent > 100) {
+            fprintf(stderr, "buddy: maximum order must be 0-%d and the percentage 1-100\n", BUDDY_ORDERS - 1);
+        } else {
+            buddy_benchmark(atol(args[2]), max_order, percent);
+        }
+    } else {
+        fprintf(stderr, "buddy: usage: buddy [reset|bench <operations> [<max order> [<percent held>]]]\n");
+    }
+}
+
+// Function to add a frame to the tail of the dirty queue
+void dirty_queue_add(int frame_number) {
+    FrameTableEntry *entry = &frame_table[frame_number];
+    if (entry->dirty_queued) {
+        return;
+    }
+    entry->dirty_queued = 1;
+    entry->dirty_prev = dirty_queue_tail;
+    entry->dirty_next = -1;
+    if (dirty_queue_tail != -1) {
+        frame_table[dirty_queue_tail].dirty_next = frame_number;
+    } else {
+        dirty_queue_head = frame_number;
+    }
+    dirty_queue_tail = frame_number;
+    dirty_frame_count++;
+}
+
+// Function to remove a frame from the dirty queue
+void dirty_queue_remove(int frame_number) {
+    FrameTableEntry *entry = &frame_table[frame_number];
+    if (!entry->dirty_queued) {
+        return;
+    }
+    if (entry->dirty_prev != -1) {
+        frame_table[entry->dirty_prev].dirty_next = entry->dirty_next;
+    } else {
+        dirty_queue_head = entry->dirty_next;
+    }
+    if (entry->dirty_next != -1) {
+        frame_table[entry->dirty_next].dirty_prev = entry->dirty_prev;
+    } else {
+        dirty_queue_tail = entry->dirty_prev;
+    }
+    entry->dirty_queued = 0;
+    dirty_frame_count--;
+}
+
+// Function to get the dirty-frame count above which the cleaner starts writing back
+int cleaner_high_frames() {
+    return (int)((long)num_frames * cleaner.high_percent / 100);
+}
+
+// Function to get the dirty-frame count at which the cleaner stops writing back
+int cleaner_low_frames() {
+    return (int)((long)num_frames * cleaner.low_percent / 100);
+}
+
+// Function to record a write to a resident page, waking the cleaner when
+// too many frames are dirty
+void mark_page_dirty(int process_id, int page_number) {
+    PageTableEntry *entry = pt_lookup(&page_tables[process_id], page_number);
+    if (entry == NULL || !entry->valid) {
+        return;
+    }
+    if (frame_table[entry->frame_number].map_count > 1) {
+        entry = break_cow(process_id, page_number);  // Write fault on a shared frame
+        if (entry == NULL) {
+            fprintf(stderr, "Cannot give page %d of process %d a private copy\n", page_number, process_id);
+            return;
+        }
+    } else if (page_cache_remove(entry->frame_number)) {
+        page_cache.privatized++;  // The only mapper may write the cached frame itself
+    }
+    if (entry->modified) {
+        return;
+    }
+    entry->modified = 1;
+    if (entry->zswap_entry != -1) {
+        zswap_drop(entry);  // The compressed copy is stale now
+        zswap.invalidates++;
+    }
+    dirty_queue_add(entry->frame_number);
+    if (cleaner.running && dirty_frame_count > cleaner_high_frames()) {
+        pthread_cond_signal(&cleaner_wakeup);
+    }
+}
+
+// Function to close the fault gate, wait for the fault workers inside it to
+// leave and apply the policy updates they queued. Called with pager_lock held.
+void close_fault_gate() {
+    atomic_store(&fault_gate_closed, 1);
+    for (int i = 0; i < fault_worker_count; i++) {
+        while (atomic_load(&fault_workers[i].inside)) {
+            sched_yield();
+        }
+    }
+
+    // Only once every worker is out: one still inside may be draining its
+    // own batch under policy_lock, and the drains update the same lists
+    for (int i = 0; i < fault_worker_count; i++) {
+        drain_fault_batch(&fault_workers[i]);
+    }
+}
+
+// Function to take the pager lock, keeping fault workers out until unlock_pager()
+void lock_pager() {
+    pthread_mutex_lock(&pager_lock);
+    close_fault_gate();
+}
+
+// Function to release the pager lock and let fault workers back in
+void unlock_pager() {
+    atomic_store(&fault_gate_closed, 0);
+    pthread_mutex_unlock(&pager_lock);
+}
+
+// Function to wait on a condition with the pager lock held, like
+// pthread_cond_wait(). Fault workers may run while the caller sleeps.
+// Waits until the deadline at most, unless it is NULL.
+void pager_cond_wait(pthread_cond_t *condition, const struct timespec *deadline) {
+    atomic_store(&fault_gate_closed, 0);
+    if (deadline != NULL) {
+        pthread_cond_timedwait(condition, &pager_lock, deadline);
+    } else {
+        pthread_cond_wait(condition, &pager_lock);
+    }
+    close_fault_gate();
+}
+
+// Function to enter the fault gate, waiting while someone holds the pager lock
+void enter_fault_gate(FaultWorker *worker) {
+    while (1) {
+        atomic_store(&worker->inside, 1);
+        if (!atomic_load(&fault_gate_closed)) {
+            return;
+        }
+        atomic_store(&worker->inside, 0);
+        pthread_mutex_lock(&pager_lock);  // Sleep until the holder is done
+        pthread_mutex_unlock(&pager_lock);
+    }
+}
+
+// Function to leave the fault gate
+void leave_fault_gate(FaultWorker *worker) {
+    atomic_store(&worker->inside, 0);
+}
+
+// Function to wait until no writeback is in flight for a frame. Called with
+// pager_lock held; the lock is released while waiting.
+void wait_for_writeback(int frame_number) {
+    while (frame_table[frame_number].writeback) {
+        pager_cond_wait(&writeback_done, NULL);
+    }
+}
+
+// Function to write back the oldest dirty frame ahead of eviction. Called with
+// pager_lock held; the lock is dropped during the write so faults can proceed.
+// Returns 0 if there was nothing to clean.
+int clean_oldest_dirty_frame() {
+    int frame = dirty_queue_head;
+    if (frame == -1) {
+        return 0;
+    }
+    int process_id = frame_table[frame].process_id;
+    int page_number = frame_table[frame].page_number;
+    PageTableEntry *entry = pt_lookup(&page_tables[process_id], page_number);
+    dirty_queue_remove(frame);
+    if (frame_table[frame].map_count > 1) {
+        // Shared frames are rare, so they are written under the lock
+        if (write_shared_frame_to_swap(frame) != 0) {
+            dirty_queue_add(frame);
+            return 0;
+        }
+        cleaner.pages_written++;
+        return 1;
+    }
+    if (zswap_store(process_id, page_number, frame) == 0) {
+        // Compressed in place: no I/O, so the lock stays held
+        entry->modified = 0;
+        cleaner.pages_written++;
+        return 1;
+    }
+    int old_slot = entry->swap_slot;
+    if (open_swap_device() != 0 || own_swap_slot(entry) == -1) {
+        dirty_queue_add(frame);  // Swap is full; the page stays dirty, and queued so the OOM killer counts it
+        return 0;
+    }
+
+    // Snapshot the page so writes during the I/O cannot tear it. The page is
+    // clean from now on; a write during the I/O dirties it again.
+    entry->modified = 0;
+    frame_table[frame].writeback = 1;
+    off_t offset = (off_t)entry->swap_slot * PAGE_SIZE;
+    char buffer[PAGE_SIZE];
+    memcpy(buffer, frame_data(frame), PAGE_SIZE);
+
+    unlock_pager();
+    int written = pwrite(swap_fd, buffer, PAGE_SIZE, offset) == PAGE_SIZE;
+    if (!written) {
+        perror("Error writing back page to swap file");
+    }
+    lock_pager();
+
+    frame_table[frame].writeback = 0;
+    pthread_cond_broadcast(&writeback_done);
+    if (!written) {
+        // The page is dirty again, unless a write during the I/O already made it so
+        entry = pt_lookup(&page_tables[process_id], page_number);
+        if (entry->swap_slot != old_slot) {
+            free_swap_slot(entry->swap_slot);  // Taken for this write, which never landed
+            entry->swap_slot = -1;
+        }
+        if (!entry->modified) {
+            entry->modified = 1;
+            dirty_queue_add(frame);
+        }
+        return 0;
+    }
+    cleaner.pages_written++;
+    swap_outs++;
+    return 1;
+}
+
+// Function run by the background cleaner thread. It sleeps until the dirty
+// frames exceed the high watermark (or the interval expires) and then writes
+// back the oldest dirty frames until they are under the low watermark. When
+// swap is full it waits out the interval before trying again.
+void *cleaner_thread(void *arg) {
+    (void)arg;
+    int stalled = 0;  // 1 if the last pass stopped because swap is full
+    lock_pager();
+    while (cleaner.running) {
+        if (dirty_frame_count <= cleaner_high_frames() || stalled) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += CLEANER_INTERVAL_MS * 1000000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            pager_cond_wait(&cleaner_wakeup, &deadline);
+            stalled = 0;
+            continue;
+        }
+        cleaner.wakeups++;
+        while (cleaner.running && dirty_frame_count > cleaner_low_frames()) {
+            if (!clean_oldest_dirty_frame()) {
+                stalled = 1;
+                break;
+            }
+        }
+    }
+    unlock_pager();
+    return NULL;
+}
+
+// Function to start the background cleaner thread
+void start_cleaner() {
+    lock_pager();
+    if (cleaner.running) {
+        unlock_pager();
+        return;
+    }
+    cleaner.running = 1;
+    unlock_pager();
+    if (pthread_create(&cleaner.thread, NULL, cleaner_thread, NULL) != 0) {
+        perror("Error starting cleaner thread");
+        cleaner.running = 0;
+    }
+}
+
+// Function to stop the background cleaner thread and wait for it to exit
+void stop_cleaner() {
+    lock_pager();
+    if (!cleaner.running) {
+        unlock_pager();
+        return;
+    }
+    cleaner.running = 0;
+    pthread_cond_signal(&cleaner_wakeup);
+    unlock_pager();
+    pthread_join(cleaner.thread, NULL);
+}
+
+// Function to display the cleaner state and fault-handler latency
+void show_cleaner_stats() {
+    printf("Cleaner: %s, watermarks %d%%/%d%% (%d/%d frames)\n", cleaner.running ? "on" : "off",
+           cleaner.low_percent, cleaner.high_percent, cleaner_low_frames(), cleaner_high_frames());
+    printf("  Dirty frames:     %d\n", dirty_frame_count);
+    printf("  Pages written:    %ld in %ld wakeups\n", cleaner.pages_written, cleaner.wakeups);
+    printf("  Clean evictions:  %ld\n", clean_evictions);
+    printf("  Dirty evictions:  %ld (written synchronously by the fault handler)\n", dirty_evictions);
+    printf("Fault-handler latency:\n");
+    print_latency_summary("All faults", &fault_latency);
+}
+
+// Function to handle the cleaner builtin
+void cleaner_command(char **args) {
+    if (args[1] == NULL) {
+        show_cleaner_stats();
+    } else if (strcmp(args[1], "on") == 0) {
+        start_cleaner();
+    } else if (strcmp(args[1], "off") == 0) {
+        stop_cleaner();
+    } else if (strcmp(args[1], "reset") == 0) {
+        lock_pager();
+        memset(&fault_latency, 0, sizeof(fault_latency));
+        cleaner.pages_written = 0;
+        cleaner.wakeups = 0;
+        clean_evictions = 0;
+        dirty_evictions = 0;
+        unlock_pager();
+    } else if (args[2] != NULL && atoi(args[1]) >= 0 && atoi(args[1]) < atoi(args[2]) && atoi(args[2]) <= 100) {
+        lock_pager();
+        cleaner.low_percent = atoi(args[1]);
+        cleaner.high_percent = atoi(args[2]);
+        pthread_cond_signal(&cleaner_wakeup);
+        unlock_pager();
+    } else {
+        fprintf(stderr, "cleaner: usage: cleaner [on|off|reset|<low%%> <high%%>]\n");
+    }
+}
+
+// Function to take a snapshot of the vmstat counters. The caller must hold
+// pager_lock.
+void take_vmstat_sample(VmstatSample *sample) {
+    sample->free_frames = get_free_frame_count();
+    sample->used_frames = get_used_frame_count();
+    sample->minor_faults = minor_faults;
+    sample->major_faults = major_faults;
+    sample->evictions = clean_evictions + dirty_evictions;
+    sample->dirty_evictions = dirty_evictions;
+    sample->cleaner_writes = cleaner.pages_written;
+    sample->swap_ins = swap_ins;
+    sample->swap_outs = swap_outs;
+    sample->zswap_pages = zswap.stored_pages;
+    sample->fault_ns = fault_latency.total_ns;
+    sample->oom_kills = oom_killer.kills;
+}
+
+// Function to display the pager's counters, the memory of each process and
+// the fault latency
+void show_vmstat() {
+    lock_pager();
+    VmstatSample sample;
+    take_vmstat_sample(&sample);
+    printf("Faults:       %ld minor, %ld major, %ld hits\n", sample.minor_faults, sample.major_faults, current_policy->hits);
+    printf("Evictions:    %ld (%ld clean, %ld dirty)\n", sample.evictions, sample.evictions - sample.dirty_evictions,
+           sample.dirty_evictions);
+    printf("Writebacks:   %ld by the fault handler, %ld by the cleaner, %ld from the compressed pool\n",
+           sample.dirty_evictions, sample.cleaner_writes, zswap.writebacks);
+    printf("Swap:         %ld ins, %ld outs, %ld pages compressed\n", sample.swap_ins, sample.swap_outs, sample.zswap_pages);
+    printf("Frames:       %d free, %d used of %d\n", sample.free_frames, sample.used_frames, num_frames);
+    printf("OOM kills:    %ld\n", sample.oom_kills);
+    printf("Trace level:  %s\n", trace_level_names[pager_trace_level]);
+    if (vmstat_log.running) {
+        printf("Logging:      to %s every %d ms, %ld rows\n", vmstat_log.path, vmstat_log.interval_ms, vmstat_log.rows);
+    } else {
+        printf("Logging:      off\n");
+    }
+    printf("Resident memory by process:\n");
+    printf("  %5s %9s %11s %9s %10s\n", "PID", "RSS", "RSS KB", "Frames", "Faults");
+    for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+        PageTable *pt = &page_tables[process_id];
+        if (pt->num_entries == 0) {
+            continue;
+        }
+        printf("  %5d %9d %11ld %9d %10ld\n", process_id, pt->resident_pages, (long)pt->resident_pages * PAGE_SIZE / 1024,
+               process_frame_count[process_id], working_sets[process_id].faults);
+    }
+    printf("Fault latency:\n");
+    print_latency_summary("All faults", &fault_latency);
+    for (int tier = 0; tier < FAULT_TIERS; tier++) {
+        print_latency_summary(fault_tier_names[tier], &tier_latency[tier]);
+    }
+    unlock_pager();
+}
+
+// Function run by the vmstat log thread. It appends a row of counters to the
+// log file every interval; the counters are cumulative, so the difference
+// between two rows gives the rates over the interval.
+void *vmstat_log_thread(void *arg) {
+    (void)arg;
+    double start = now_seconds();
+    lock_pager();
+    while (vmstat_log.running) {
+        VmstatSample sample;
+        take_vmstat_sample(&sample);
+        vmstat_log.rows++;
+        unlock_pager();
+        fprintf(vmstat_log.file, "%.3f,%d,%d,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld\n", now_seconds() - start,
+                sample.free_frames, sample.used_frames, sample.minor_faults, sample.major_faults, sample.evictions,
+                sample.dirty_evictions, sample.cleaner_writes, sample.swap_ins, sample.swap_outs, sample.zswap_pages,
+                sample.fault_ns, sample.oom_kills);
+        fflush(vmstat_log.file);
+        lock_pager();
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += vmstat_log.interval_ms % 1000 * 1000000L;
+        deadline.tv_sec += vmstat_log.interval_ms / 1000 + deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        if (vmstat_log.running) {
+            pager_cond_wait(&vmstat_log_wakeup, &deadline);
+        }
+    }
+    unlock_pager();
+    return NULL;
+}
+
+// Function to stop the vmstat log thread, wait for it to exit and close the log
+void stop_vmstat_log() {
+    lock_pager();
+    if (!vmstat_log.running) {
+        unlock_pager();
+        return;
+    }
+    vmstat_log.running = 0;
+    pthread_cond_signal(&vmstat_log_wakeup);
+    unlock_pager();
+    pthread_join(vmstat_log.thread, NULL);
+    fclose(vmstat_log.file);
+    vmstat_log.file = NULL;
+}
+
+// Function to start logging the vmstat counters to a CSV file, replacing any
+// log already running
+void start_vmstat_log(const char *path, int interval_ms) {
+    stop_vmstat_log();
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror("Error opening vmstat log");
+        return;
+    }
+    fprintf(file, "seconds,free_frames,used_frames,minor_faults,major_faults,evictions,dirty_evictions,"
+                  "cleaner_writes,swap_ins,swap_outs,zswap_pages,fault_ns,oom_kills\n");
+    lock_pager();
+    vmstat_log.file = file;
+    snprintf(vmstat_log.path, sizeof(vmstat_log.path), "%s", path);
+    vmstat_log.interval_ms = interval_ms;
+    vmstat_log.rows = 0;
+    vmstat_log.running = 1;
+    unlock_pager();
+    if (pthread_create(&vmstat_log.thread, NULL, vmstat_log_thread, NULL) != 0) {
+        perror("Error starting vmstat log thread");
+        vmstat_log.running = 0;
+        fclose(file);
+        vmstat_log.file = NULL;
+    }
+}
+
+// Function to handle the vmstat builtin
+void vmstat_command(char **args) {
+    if (args[1] == NULL) {
+        show_vmstat();
+    } else if (strcmp(args[1], "trace") == 0 && args[2] != NULL) {
+        int level = -1;
+        for (int i = TRACE_OFF; i <= TRACE_PAGES; i++) {
+            if (strcmp(args[2], trace_level_names[i]) == 0) {
+                level = i;
+            }
+        }
+        if (level == -1) {
+            fprintf(stderr, "vmstat: trace level must be off, events or pages\n");
+            return;
+        }
+        lock_pager();
+        pager_trace_level = level;
+        unlock_pager();
+    } else if (strcmp(args[1], "log") == 0 && args[2] != NULL && strcmp(args[2], "off") == 0) {
+        stop_vmstat_log();
+    } else if (strcmp(args[1], "log") == 0 && args[2] != NULL) {
+        int interval_ms = args[3] != NULL ? atoi(args[3]) : VMSTAT_DEFAULT_INTERVAL_MS;
+        if (interval_ms <= 0) {
+            fprintf(stderr, "vmstat: interval must be a positive number of milliseconds\n");
+            return;
+        }
+        start_vmstat_log(args[2], interval_ms);
+    } else if (strcmp(args[1], "reset") == 0) {
+        lock_pager();
+        minor_faults = 0;
+        major_faults = 0;
+        unlock_pager();
+    } else {
+        fprintf(stderr, "vmstat: usage: vmstat [trace <off|events|pages> | log <file.csv> [<interval ms>] | log off | reset]\n");
+    }
+}
+
+// Function to hash the contents of a frame
+uint64_t hash_frame(int frame_number) {
+    const char *data = frame_data(frame_number);
+    uint64_t hash = 0;
+    for (int i = 0; i < PAGE_SIZE; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+// Function to move every page mapping a frame onto an identical target frame
+// and free the frame. The target is dirty afterwards if either frame was.
+void merge_frames(int frame_number, int target) {
+    int dirty = is_page_modified(&page_tables[frame_table[frame_number].process_id], frame_table[frame_number].page_number) ||
+                is_page_modified(&page_tables[frame_table[target].process_id], frame_table[target].page_number);
+    int position = -2, process_id, page_number;
+    while (next_frame_mapping(frame_number, &position, &process_id, &page_number)) {
+        pt_lookup(&page_tables[process_id], page_number)->frame_number = target;
+        rmap_add(target, process_id, page_number);
+        tlb_shootdown(process_id, page_number);
+        merger.pages_merged++;
+    }
+    rmap_clear(frame_number);
+    frame_table[frame_number].prefetched = 0;  // Merged away, not wasted
+    free_frame(frame_number);
+
+    // Sharers of a frame agree on whether it is dirty, and dirty pages have no compressed copy
+    if (dirty) {
+        position = -2;
+        while (next_frame_mapping(target, &position, &process_id, &page_number)) {
+            PageTableEntry *entry = pt_lookup(&page_tables[process_id], page_number);
+            entry->modified = 1;
+            if (entry->zswap_entry != -1) {
+                zswap_drop(entry);
+            }
+        }
+        dirty_queue_add(target);
+    }
+    frame_table[target].merged = 1;
+}
+
+// Function to scan one frame. Frames whose contents did not change since the
+// previous scan are looked up by content hash and, once a byte-for-byte
+// comparison confirms the match, merged into the frame found.
+void merger_scan_frame(int frame_number) {
+    FrameTableEntry *frame = &frame_table[frame_number];
+    merger.frames_scanned++;
+    if (!frame_holds_page(frame_number) || frame->writeback || frame->map_count >= MERGER_MAX_SHARING || frame_in_huge_page(frame_number) ||
+        live_pager_frame(frame_number) || frame->cached) {
+        return;  // Merging a huge page's frame away would split it, and the page cache already shares cached frames
+    }
+    uint64_t hash = hash_frame(frame_number);
+    if ((uint32_t)hash != merge_checksums[frame_number]) {
+        merge_checksums[frame_number] = (uint32_t)hash;  // Changing too often to be worth merging
+        return;
+    }
+
+    long *slot = page_map_insert(&merger.hashes, hash);
+    int target = (int)*slot - 1;
+    if (target < 0 || target == frame_number || !frame_holds_page(target) || live_pager_frame(target) || frame_table[target].cached ||
+        memcmp(frame_data(target), frame_data(frame_number), PAGE_SIZE) != 0) {
+        *slot = frame_number + 1;  // First frame with this content, or the old one changed
+    } else if (!frame_table[target].writeback && frame_table[target].map_count + frame->map_count <= MERGER_MAX_SHARING) {
+        merge_frames(frame_number, target);
+    }
+}
+
+// Function to scan the next count frames, starting a new scan after the last frame
+void merger_scan(int count) {
+    long start = now_nanoseconds();
+    if (merger.hashes.capacity == 0 && page_map_init(&merger.hashes, 1024) != 0) {
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        merger_scan_frame(merger.cursor);
+        if (++merger.cursor == num_frames) {
+            merger.cursor = 0;
+            merger.full_scans++;
+            page_map_clear(&merger.hashes);
+        }
+    }
+    merger.scan_ns += now_nanoseconds() - start;
+}
+
+// Function run by the background merger thread. Every interval it scans a
+// batch of frames under the pager lock.
+void *merger_thread(void *arg) {
+    (void)arg;
+    lock_pager();
+    while (merger.running) {
+        merger_scan(merger.pages_per_pass);
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += merger.interval_ms * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        pager_cond_wait(&merger_wakeup, &deadline);
+    }
+    unlock_pager();
+    return NULL;
+}
+
+// Function to start the background merger thread
+void start_merger() {
+    lock_pager();
+    if (merger.running) {
+        unlock_pager();
+        return;
+    }
+    merger.running = 1;
+    if (merger.since == 0) {
+        merger.since = now_seconds();
+    }
+    unlock_pager();
+    if (pthread_create(&merger.thread, NULL, merger_thread, NULL) != 0) {
+        perror("Error starting merger thread");
+        merger.running = 0;
+    }
+}
+
+// Function to stop the background merger thread and wait for it to exit
+void stop_merger() {
+    lock_pager();
+    if (!merger.running) {
+        unlock_pager();
+        return;
+    }
+    merger.running = 0;
+    pthread_cond_signal(&merger_wakeup);
+    unlock_pager();
+    pthread_join(merger.thread, NULL);
+}
+
+// Function to display the merger state, frames saved and scan cost
+void show_merger_stats() {
+    long merged_frames = 0;
+    long frames_saved = 0;
+    for (int frame = 0; frame < num_frames; frame++) {
+        if (frame_table[frame].merged && frame_table[frame].in_use) {
+            merged_frames++;
+            frames_saved += frame_table[frame].map_count - 1;
+        }
+    }
+    double elapsed = merger.since > 0 ? now_seconds() - merger.since : 0;
+    printf("Merger: %s, %d frames every %d ms\n", merger.running ? "on" : "off", merger.pages_per_pass, merger.interval_ms);
+    printf("  Frames saved:     %ld (%ld KB), %ld merged frames\n", frames_saved, frames_saved * PAGE_SIZE / 1024, merged_frames);
+    printf("  Pages merged:     %ld\n", merger.pages_merged);
+    printf("  Frames scanned:   %ld in %ld full scans\n", merger.frames_scanned, merger.full_scans);
+    if (elapsed > 0) {
+        printf("  Scan cost:        %.2f ms per second, %.0f frames per second\n", merger.scan_ns / 1e6 / elapsed,
+               merger.frames_scanned / elapsed);
+    }
+    if (merger.frames_scanned > 0) {
+        printf("                    %.2f us per frame\n", merger.scan_ns / 1000.0 / merger.frames_scanned);
+    }
+}
+
+// Function to handle the merge builtin
+void merger_command(char **args) {
+    if (args[1] == NULL) {
+        lock_pager();
+        show_merger_stats();
+        unlock_pager();
+    } else if (strcmp(args[1], "on") == 0) {
+        start_merger();
+    } else if (strcmp(args[1], "off") == 0) {
+        stop_merger();
+    } else if (strcmp(args[1], "scan") == 0) {
+        lock_pager();
+        if (merger.since == 0) {
+            merger.since = now_seconds();
+        }
+        merger_scan(num_frames);
+        unlock_pager();
+    } else if (strcmp(args[1], "reset") == 0) {
+        lock_pager();
+        merger.frames_scanned = 0;
+        merger.full_scans = 0;
+        merger.pages_merged = 0;
+        merger.scan_ns = 0;
+        merger.since = now_seconds();
+        unlock_pager();
+    } else if (args[2] != NULL && atoi(args[1]) > 0 && atoi(args[2]) > 0) {
+        lock_pager();
+        merger.pages_per_pass = atoi(args[1]);
+        merger.interval_ms = atoi(args[2]);
+        pthread_cond_signal(&merger_wakeup);
+        unlock_pager();
+    } else {
+        fprintf(stderr, "merge: usage: merge [on|off|scan|reset|<frames per pass> <interval ms>]\n");
+    }
+}
+
+// Function to check whether load control may steer evictions. OPT must keep
+// the victims it picks from the reference string, like with huge pages.
+int load_control_usable() {
+    return load_control.enabled && current_policy->on_access != opt_on_access;
+}
+
+// Function to check whether a frame's page is inside its owner's working set
+int frame_in_working_set(int frame_number) {
+    WorkingSet *ws = &working_sets[frame_table[frame_number].process_id];
+    return ws->virtual_time - frame_last_reference[frame_number] < load_control.window;
+}
+
+// Function to account for a reference by a process to a resident frame
+void note_working_set_reference(int process_id, int frame_number, int faulted) {
+    WorkingSet *ws = &working_sets[process_id];
+    ws->virtual_time++;
+    ws->interval_references++;
+    ws->faults += faulted;
+    ws->interval_faults += faulted;
+    if (frame_table[frame_number].process_id == process_id) {
+        frame_last_reference[frame_number] = ws->virtual_time;
+    }
+    load_control.references++;
+}
+
+// Function to pick a victim under load control. A suspended process gives
+// up its frames first, taken straight from its list. Otherwise the
+// working-set clock hand sweeps the frames for a page outside its owner's
+// working set, remembering the first page of a process over its quota in
+// case there is none. Returns -1 if no page qualifies; the sweep is then
+// skipped until the next estimate, leaving victims to the replacement policy.
+int working_set_select_victim() {
+    for (int process_id = 0; load_control.suspended_processes > 0 && process_id < MAX_PROCESSES; process_id++) {
+        for (int frame = process_frame_head[process_id]; working_sets[process_id].suspended && frame != -1;
+             frame = frame_table[frame].owner_next) {
+            if (!frame_table[frame].writeback) {
+                load_control.stale_evictions++;
+                return frame;
+            }
+        }
+    }
+    if (load_control.saturated) {
+        return -1;
+    }
+    int over_quota = -1;
+    for (int scanned = 0; scanned < num_frames; scanned++) {
+        int frame = load_control.hand;
+        load_control.hand = (load_control.hand + 1) % num_frames;
+        if (!frame_holds_page(frame) || frame_table[frame].writeback) {
+            continue;
+        }
+        int owner = frame_table[frame].process_id;
+        if (working_sets[owner].suspended || !frame_in_working_set(frame)) {
+            load_control.stale_evictions++;
+            return frame;
+        }
+        if (over_quota == -1 && working_sets[owner].quota > 0 && process_frame_count[owner] > working_sets[owner].quota) {
+            over_quota = frame;
+        }
+    }
+    load_control.saturated = 1;
+    load_control.quota_evictions += over_quota != -1;
+    return over_quota;
+}
+
+// Function to suspend a process: it is held back from running and its
+// frames become the first victims
+void suspend_process(int process_id) {
+    WorkingSet *ws = &working_sets[process_id];
+    ws->suspended = 1;
+    ws->suspended_wss = ws->wss;
+    ws->suspended_at = load_control.estimates;
+    ws->quota = 0;
+    load_control.suspended_processes++;
+    load_control.suspensions++;
+    if (pager_trace_level >= TRACE_EVENTS) {
+        printf("Suspended process %d: working sets exceed memory (its working set is %d pages)\n", process_id, ws->wss);
+    }
+}
+
+// Function to let a suspended process run again
+void resume_process(int process_id) {
+    WorkingSet *ws = &working_sets[process_id];
+    ws->suspended = 0;
+    load_control.suspended_processes--;
+    ws->quota = ws->suspended_wss > WS_MIN_QUOTA ? ws->suspended_wss : WS_MIN_QUOTA;
+    load_control.resumptions++;
+    if (pager_trace_level >= TRACE_EVENTS) {
+        printf("Resumed process %d\n", process_id);
+    }
+}
+
+// Function to suspend or resume a process after an estimate. Memory is
+// overcommitted when the replacement policy had to evict pages inside
+// working sets during the interval; the running process with the largest
+// working set is then suspended, as long as another keeps running. Otherwise
+// the process suspended longest is resumed once the free frames and those
+// outside every working set could hold the working set it had.
+void balance_load(int reclaimable_frames) {
+    int largest = -1;
+    int running = 0;
+    int resumable = -1;
+    for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+        WorkingSet *ws = &working_sets[process_id];
+        if (page_tables[process_id].num_entries == 0) {
+            continue;
+        }
+        if (ws->suspended) {
+            if (resumable == -1 || ws->suspended_at < working_sets[resumable].suspended_at) {
+                resumable = process_id;
+            }
+        } else if (ws->interval_references > 0) {
+            running++;
+            if (largest == -1 || ws->wss > working_sets[largest].wss) {
+                largest = process_id;
+            }
+        }
+    }
+
+    if (load_control.interval_fallbacks > 0) {
+        if (running > 1) {
+            suspend_process(largest);
+        }
+    } else if (resumable != -1 && working_sets[resumable].suspended_wss <= reclaimable_frames) {
+        resume_process(resumable);
+    }
+}
+
+// Function to get the number of references between working-set estimates.
+// An estimate walks every process's frames, so spacing estimates by an
+// eighth of the frames in use keeps the cost at O(1) per reference.
+long working_set_estimate_interval() {
+    return used_frame_count / 8 > WS_MIN_ESTIMATE_INTERVAL ? used_frame_count / 8 : WS_MIN_ESTIMATE_INTERVAL;
+}
+
+// Function to estimate the working set of every process by walking its
+// frames, derive the quotas and fault rates for the interval since the
+// last estimate, and apply load control if asked to
+void estimate_working_sets(int apply_load_control) {
+    int reclaimable_frames = get_free_frame_count();
+    for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+        WorkingSet *ws = &working_sets[process_id];
+        ws->wss = 0;
+        for (int frame = process_frame_head[process_id]; frame != -1; frame = frame_table[frame].owner_next) {
+            if (frame_in_working_set(frame) && !ws->suspended) {
+                ws->wss++;
+            } else {
+                reclaimable_frames++;
+            }
+        }
+        if (ws->interval_references > 0) {
+            ws->fault_rate = 1000.0 * ws->interval_faults / ws->interval_references;
+        }
+        ws->thrashing = ws->interval_lost_pages > 0;
+        if (!ws->suspended) {
+            ws->quota = ws->wss > WS_MIN_QUOTA ? ws->wss : WS_MIN_QUOTA;
+        }
+    }
+    if (apply_load_control && load_control_usable()) {
+        balance_load(reclaimable_frames);
+    }
+
+    for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+        working_sets[process_id].interval_references = 0;
+        working_sets[process_id].interval_faults = 0;
+        working_sets[process_id].interval_lost_pages = 0;
+    }
+    load_control.references = 0;
+    load_control.interval_fallbacks = 0;
+    load_control.saturated = 0;
+    load_control.estimates++;
+}
+
+// Function to display the resident set, working set and fault rate of every
+// process, after a fresh estimate
+void show_working_sets() {
+    estimate_working_sets(0);
+    long total_wss = 0;
+    for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+        total_wss += working_sets[process_id].wss;
+    }
+    printf("Load control: %s, window %ld references, %ld estimates\n", load_control.enabled ? "on" : "off",
+           load_control.window, load_control.estimates);
+    printf("  Frames:           %d usable, %d free, %ld in working sets\n", num_frames - buddy.shell_frames,
+           get_free_frame_count(), total_wss);
+    printf("  Evictions:        %ld stale, %ld over quota, %ld inside a working set\n", load_control.stale_evictions,
+           load_control.quota_evictions, load_control.fallback_evictions);
+    printf("  Suspensions:      %ld (%ld resumed), %d suspended now\n", load_control.suspensions, load_control.resumptions,
+           load_control.suspended_processes);
+    printf("  %5s %9s %9s %9s %10s %9s %9s  %s\n", "PID", "RSS", "WSS", "Quota", "Faults", "Rate/1k", "Lost", "State");
+    for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+        WorkingSet *ws = &working_sets[process_id];
+        if (page_tables[process_id].num_entries == 0) {
+            continue;
+        }
+        printf("  %5d %9d %9d %9d %10ld %9.1f %9ld  %s\n", process_id, page_tables[process_id].resident_pages, ws->wss,
+               ws->quota, ws->faults, ws->fault_rate, ws->lost_pages,
+               ws->suspended ? "suspended" : ws->thrashing ? "thrashing" : "running");
+    }
+}
+
+// Function to handle the ws builtin
+void working_set_command(char **args) {
+    if (args[1] == NULL) {
+        show_working_sets();
+    } else if (strcmp(args[1], "on") == 0) {
+        load_control.enabled = 1;
+    } else if (strcmp(args[1], "off") == 0) {
+        load_control.enabled = 0;
+        for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+            if (working_sets[process_id].suspended) {
+                resume_process(process_id);
+            }
+        }
+    } else if (strcmp(args[1], "window") == 0 && args[2] != NULL && atol(args[2]) > 0) {
+        load_control.window = atol(args[2]);
+    } else if (strcmp(args[1], "reset") == 0) {
+        load_control.stale_evictions = 0;
+        load_control.quota_evictions = 0;
+        load_control.fallback_evictions = 0;
+        load_control.suspensions = 0;
+        load_control.resumptions = 0;
+        for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+            working_sets[process_id].faults = 0;
+            working_sets[process_id].lost_pages = 0;
+        }
+    } else {
+        fprintf(stderr, "ws: usage: ws [on|off|window <references>|reset]\n");
+    }
+}
+
+// Function to save a victim's page before its frame is reused: a dirty page
+// goes to the compressed pool or swap. Returns 1 if the page was dirty, 0 if
+// it was clean, -1 if it was dirty and could not be saved.
+int save_victim(int frame) {
+    int process_id = frame_table[frame].process_id;
+    int page_number = frame_table[frame].page_number;
+    live_pager_evict(process_id, page_number, frame);
+    if (!is_page_modified(&page_tables[process_id], page_number)) {
+        return 0;
+    }
+    if (frame_table[frame].map_count > 1) {
+        return write_shared_frame_to_swap(frame) == 0 ? 1 : -1;
+    }
+    if (zswap_store(process_id, page_number, frame) != 0 && write_page_to_swap(process_id, page_number, frame) != 0) {
+        return -1;
+    }
+    return 1;
+}
+
+// Function to get a frame for a page, evicting a victim when no frame is
+// free: a page outside every working set under load control, else the one
+// the replacement policy chooses. Returns -1 if no frame is free and the
+// policy has no victim, which happens when every frame in use belongs to the
+// shell or sits in a fault worker's frame cache, or when every victim tried
+// was dirty and could not be saved.
+int obtain_frame(int process_id, int page_number) {
+    int frame = allocate_frame(process_id, page_number);
+    if (frame != -1) {
+        return frame;
+    }
+
+    // A dirty victim that neither the compressed pool nor swap can take stays
+    // resident and dirty. It leaves the policy while another victim is chosen
+    // and is loaded back into it afterwards.
+    ReplacementPolicy *policy = current_policy;
+    int skipped[EVICTION_MAX_RETRIES];
+    int skipped_count = 0;
+    int saved = -1;
+    while (saved == -1 && skipped_count < EVICTION_MAX_RETRIES) {
+        int from_policy = 0;
+        frame = load_control_usable() && skipped_count == 0 ? working_set_select_victim() : -1;
+        if (frame == -1) {
+            frame = policy->select_victim();
+            from_policy = 1;
+        }
+        if (frame == -1) {
+            break;
+        }
+        wait_for_writeback(frame);
+        saved = save_victim(frame);
+        if (saved == -1) {
+            policy->on_remove(frame, 0);
+            skipped[skipped_count++] = frame;
+        } else if (from_policy && load_control_usable()) {
+            load_control.fallback_evictions++;
+            load_control.interval_fallbacks++;
+        }
+    }
+    for (int i = 0; i < skipped_count; i++) {
+        policy->on_load(skipped[i]);
+    }
+    if (saved == -1) {
+        return -1;
+    }
+    dirty_evictions += saved;
+    clean_evictions += !saved;
+
+    int old_process_id = frame_table[frame].process_id;
+    if (frame_in_working_set(frame)) {
+        working_sets[old_process_id].lost_pages++;
+        working_sets[old_process_id].interval_lost_pages++;
+    }
+    policy->on_remove(frame, 1);
+    policy->evictions++;
+    readahead_note_release(frame);
+    page_cache.drops += page_cache_remove(frame);  // Cached frames are clean, so dropping one needs no write
+
+    // Unmap the victim page from every process sharing it
+    int position = -2, mapped_process_id, mapped_page_number;
+    while (next_frame_mapping(frame, &position, &mapped_process_id, &mapped_page_number)) {
+        pt_unmap_page(&page_tables[mapped_process_id], mapped_page_number);
+        tlb_shootdown(mapped_process_id, mapped_page_number);
+    }
+    rmap_clear(frame);
+    frame_table[frame].merged = 0;
+
+    set_frame_owner(frame, process_id, page_number);
+    frame_last_reference[frame] = working_sets[process_id].virtual_time;
+    return frame;
+}
+
+// Function to check whether a process's faults may use the page cache. OPT
+// must see every process's pages as its own, like with huge pages, and the
+// live process's writes bypass mark_page_dirty().
+int page_cache_usable(int process_id) {
+    return page_cache.enabled && current_policy->on_access != opt_on_access && process_id != LIVE_PROCESS_ID;
+}
+
+// Function to drop a frame from the page cache. Returns 1 if it was cached.
+int page_cache_remove(int frame_number) {
+    if (!frame_table[frame_number].cached) {
+        return 0;
+    }
+    uint64_t key = page_cache.keys[frame_number];
+    page_map_remove(&page_cache.index, key);
+    mapped_files[PAGE_KEY_PROCESS(key)].cached_pages--;
+    frame_table[frame_number].cached = 0;
+    return 1;
+}
+
+// Function to serve a fault from the page cache: if another mapping of the
+// file page the faulting page maps holds a frame, the page maps it too.
+// Returns 0 if the page was mapped, -1 if the page has to be read.
+int page_cache_map(int process_id, int page_number, PageTable *pt) {
+    long file_page;
+    int file = page_cache_usable(process_id) ? page_backing_file(process_id, page_number, &file_page) : -1;
+    long *slot = file != -1 && page_cache.index.capacity != 0 ? page_map_find(&page_cache.index, PAGE_KEY(file, file_page)) : NULL;
+    if (slot == NULL) {
+        return -1;
+    }
+    int frame = (int)*slot - 1;
+    pt_map_page(pt, page_number, frame);
+    rmap_add(frame, process_id, page_number);
+    frame_referenced[frame] = 1;
+    current_policy->on_access(frame);
+    page_cache.hits++;
+    if (pager_trace_level >= TRACE_PAGES) {
+        printf("Mapped cached frame %d of %s into page %d of process %d\n", frame, mapped_files[file].path, page_number, process_id);
+    }
+    return 0;
+}
+
+// Function to add a frame just read from the file backing its page to the
+// page cache, unless the page is anonymous or another frame caches it
+void page_cache_insert(int process_id, int page_number, int frame_number) {
+    long file_page;
+    int file = page_cache_usable(process_id) ? page_backing_file(process_id, page_number, &file_page) : -1;
+    if (file == -1) {
+        return;
+    }
+    if (page_cache.keys == NULL) {
+        page_cache.keys = allocate_frame_array(sizeof(uint64_t), num_frames);
+    }
+    if (page_cache.index.capacity == 0 && page_map_init(&page_cache.index, 1024) != 0) {
+        return;
+    }
+    uint64_t key = PAGE_KEY(file, file_page);
+    long *slot = page_map_insert(&page_cache.index, key);
+    if (*slot != 0) {
+        return;
+    }
+    *slot = frame_number + 1;
+    page_cache.keys[frame_number] = key;
+    frame_table[frame_number].cached = 1;
+    mapped_files[file].cached_pages++;
+    page_cache.misses++;
+}
+
+// Function to display the page cache's counters and the files it caches
+void show_page_cache() {
+    long saved = 0;
+    for (size_t i = 0; i < page_cache.index.capacity; i++) {
+        if (page_cache.index.used[i]) {
+            saved += frame_table[page_cache.index.values[i] - 1].map_count - 1;
+        }
+    }
+    printf("Page cache: %s, %ld pages (%ld KB) cached\n", page_cache.enabled ? "on" : "off", (long)page_cache.index.count,
+           (long)page_cache.index.count * PAGE_SIZE / 1024);
+    printf("  Hits:             %ld faults mapped a cached frame\n", page_cache.hits);
+    printf("  Misses:           %ld pages read from their file\n", page_cache.misses);
+    printf("  Dropped:          %ld cached frames evicted without writing\n", page_cache.drops);
+    printf("  Privatized:       %ld cached frames written by their only mapper\n", page_cache.privatized);
+    printf("  Frames saved:     %ld by sharing cached frames\n", saved);
+    printf("  %4s %6s %8s  %s\n", "File", "Users", "Cached", "Path");
+    for (int file = 0; file < MAX_MAPPED_FILES; file++) {
+        if (mapped_files[file].users > 0) {
+            printf("  %4d %6d %8ld  %s\n", file, mapped_files[file].users, mapped_files[file].cached_pages, mapped_files[file].path);
+        }
+    }
+}
+
+// Function to handle the pagecache builtin
+void page_cache_command(char **args) {
+    if (args[1] == NULL) {
+        show_page_cache();
+    } else if (strcmp(args[1], "on") == 0 || strcmp(args[1], "off") == 0) {
+        page_cache.enabled = strcmp(args[1], "on") == 0;  // Frames already cached stay shared
+    } else if (strcmp(args[1], "reset") == 0) {
+        page_cache.hits = 0;
+        page_cache.misses = 0;
+        page_cache.drops = 0;
+        page_cache.privatized = 0;
+    } else {
+        fprintf(stderr, "pagecache: usage: pagecache [on|off|reset]\n");
+    }
+}
+
+// Function to discard a range of pages of a process: their frames, swap
+// slots and compressed copies. Afterwards the pages fault in afresh.
+void release_page_range(int process_id, int first_page, int pages) {
+    PageTable *pt = &page_tables[process_id];
+    for (int page_number = first_page; page_number < first_page + pages; page_number++) {
+        PageTableEntry *entry = pt_lookup(pt, page_number);
+        if (entry == NULL || !pte_in_use(entry)) {
+            continue;
+        }
+        int frame = entry->valid ? entry->frame_number : -1;
+        if (frame != -1) {
+            wait_for_writeback(frame);  // Its swap slot must not be reused mid-write
+        }
+        if (entry->swap_slot != -1) {
+            free_swap_slot(entry->swap_slot);
+            entry->swap_slot = -1;
+        }
+        if (entry->zswap_entry != -1) {
+            zswap_drop(entry);
+        }
+        pt_unmap_page(pt, page_number);
+        tlb_shootdown(process_id, page_number);
+        if (frame != -1) {
+            release_frame_mapping(frame, process_id, page_number);
+        }
+    }
+}
+
+// Function to handle the mmap builtin: map pages of a file over a range of
+// a process's pages, replacing what the range held like MAP_FIXED would.
+// The mapping is private, so the first write to a page copies it.
+void mmap_command(char **args) {
+    int process_id = args[1] != NULL ? atoi(args[1]) : -1;
+    int first_page = args[1] != NULL && args[2] != NULL && args[3] != NULL ? atoi(args[3]) : -1;
+    int pages = first_page != -1 && args[4] != NULL ? atoi(args[4]) : 0;
+    int file_page = pages != 0 && args[5] != NULL ? atoi(args[5]) : 0;
+    if (process_id < 0 || process_id >= MAX_PROCESSES || first_page < 0 || pages < 0 || file_page < 0) {
+        fprintf(stderr, "mmap: usage: mmap <pid> <file> <first page> [<pages> [<file page>]] (pids 0-%d)\n", MAX_PROCESSES - 1);
+        return;
+    }
+
+    lock_pager();
+    ProcessResources *resources = &process_resources[process_id];
+    PageTable *pt = &page_tables[process_id];
+    if (pt->num_entries == 0) {
+        fprintf(stderr, "mmap: process %d does not exist\n", process_id);
+        unlock_pager();
+        return;
+    }
+    if (resources->num_regions == MAX_FILE_REGIONS) {
+        fprintf(stderr, "mmap: process %d already maps %d regions\n", process_id, MAX_FILE_REGIONS);
+        unlock_pager();
+        return;
+    }
+    int file = open_mapped_file(args[2]);
+    if (file == -1) {
+        fprintf(stderr, "mmap: %s: %s\n", args[2], strerror(errno));
+        unlock_pager();
+        return;
+    }
+
+    long file_pages = (mapped_files[file].size + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (pages == 0) {
+        pages = file_page < file_pages ? (int)(file_pages - file_page) : 0;
+    }
+    int overlaps = 0;
+    for (int i = 0; i < resources->num_regions; i++) {
+        FileRegion *region = &resources->regions[i];
+        overlaps = overlaps || (first_page < region->first_page + region->pages && region->first_page < first_page + pages);
+    }
+    if (file_page >= file_pages || pages == 0) {
+        fprintf(stderr, "mmap: page %d is past the end of %s\n", file_page, args[2]);
+    } else if ((long)first_page + pages > pt->num_entries) {
+        fprintf(stderr, "mmap: pages %d-%d are outside the address space of process %d\n", first_page, first_page + pages - 1, process_id);
+    } else if (overlaps) {
+        fprintf(stderr, "mmap: pages %d-%d overlap a region process %d already maps\n", first_page, first_page + pages - 1, process_id);
+    } else {
+        release_page_range(process_id, first_page, pages);
+        resources->regions[resources->num_regions++] = (FileRegion){first_page, pages, file, file_page};
+        printf("Mapped pages %d-%d of process %d to pages %d-%d of %s\n", first_page, first_page + pages - 1, process_id,
+               file_page, file_page + pages - 1, mapped_files[file].path);
+        unlock_pager();
+        return;
+    }
+    release_mapped_file(file);
+    unlock_pager();
+}
+
+// Function to handle the munmap builtin: remove the region starting at a
+// page, whose pages become anonymous again
+void munmap_command(char **args) {
+    int process_id = args[1] != NULL ? atoi(args[1]) : -1;
+    int first_page = args[1] != NULL && args[2] != NULL ? atoi(args[2]) : -1;
+    if (process_id < 0 || process_id >= MAX_PROCESSES || first_page < 0) {
+        fprintf(stderr, "munmap: usage: munmap <pid> <first page> (pids 0-%d)\n", MAX_PROCESSES - 1);
+        return;
+    }
+
+    lock_pager();
+    ProcessResources *resources = &process_resources[process_id];
+    int index = 0;
+    while (index < resources->num_regions && resources->regions[index].first_page != first_page) {
+        index++;
+    }
+    if (index == resources->num_regions) {
+        fprintf(stderr, "munmap: process %d maps no region at page %d\n", process_id, first_page);
+        unlock_pager();
+        return;
+    }
+    FileRegion region = resources->regions[index];
+    release_page_range(process_id, region.first_page, region.pages);
+    resources->regions[index] = resources->regions[--resources->num_regions];
+    release_mapped_file(region.file);
+    printf("Unmapped pages %d-%d of process %d\n", region.first_page, region.first_page + region.pages - 1, process_id);
+    unlock_pager();
+}
+
+// Function to handle a write to a page whose frame is shared: the page gets
+// a private copy of the frame and the other sharers keep the original.
+// Returns the page's entry, which now maps the private frame, or NULL if no
+// frame could be had for the copy or the page's compressed copy was corrupt.
+PageTableEntry *break_cow(int process_id, int page_number) {
+    PageTable *pt = &page_tables[process_id];
+    int frame = obtain_frame(process_id, page_number);
+    if (frame == -1) {
+        return NULL;
+    }
+
+    // Making room may have evicted the shared frame itself, in which case
+    // the page is read back like on any other fault
+    PageTableEntry *entry = pt_lookup(pt, page_number);
+    if (entry != NULL && entry->valid) {
+        int shared = entry->frame_number;
+        memcpy(frame_data(frame), frame_data(shared), PAGE_SIZE);
+        rmap_remove(shared, process_id, page_number);
+        int modified = entry->modified;
+        pt_map_page(pt, page_number, frame);
+        entry->modified = modified;
+        if (modified) {
+            dirty_queue_add(frame);
+        }
+        cow_copies++;
+        if (pager_trace_level >= TRACE_PAGES) {
+            printf("Copied shared frame %d of page %d of process %d into frame %d\n", shared, page_number, process_id, frame);
+        }
+    } else {
+        if (page_swapped_out(entry)) {
+            if (swap_in_page(process_id, page_number, frame) == -1) {
+                free_frame(frame);
+                return NULL;
+            }
+        } else {
+            load_page_from_executable(process_id, page_number, frame);
+        }
+        pt_map_page(pt, page_number, frame);
+    }
+    current_policy->on_load(frame);
+    tlb_shootdown(process_id, page_number);
+    return pt_lookup(pt, page_number);
+}
+
+// Function to read a run of consecutive pages, adding them to the page cache
+void load_pages_from_executable(int process_id, int first_page, int count, const int *frames) {
+    long file_page;
+    int file = page_backing_file(process_id, first_page, &file_page);
+    if (file != -1 && count > 1) {
+        // One hint for the whole run lets the kernel read the file in a single I/O
+        size_t size = mapped_files[file].size;
+        size_t offset = (size_t)file_page * PAGE_SIZE;
+        size_t length = (size_t)count * PAGE_SIZE < size - offset ? (size_t)count * PAGE_SIZE : size - offset;
+        madvise(mapped_files[file].data + offset, length, MADV_WILLNEED);
+        if (pager_trace_level >= TRACE_PAGES) {
+            printf("Read ahead pages %d-%d of process %d from %s\n", first_page, first_page + count - 1, process_id, mapped_files[file].path);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        load_page_from_executable(process_id, first_page + i, frames[i]);
+        page_cache_insert(process_id, first_page + i, frames[i]);
+    }
+}
+
+// Function to account for a frame leaving memory. A prefetched page that was
+// never referenced is waste, so the owner's readahead window is halved.
+void readahead_note_release(int frame_number) {
+    if (!frame_table[frame_number].prefetched) {
+        return;
+    }
+    frame_table[frame_number].prefetched = 0;
+    ReadaheadState *state = &readahead_state[frame_table[frame_number].process_id];
+    state->waste++;
+    if (state->window > 1) {
+        state->window /= 2;
+    }
+}
+
+// Function to account for a reference to a resident page
+void note_page_hit(int frame_number) {
+    frame_referenced[frame_number] = 1;
+    current_policy->hits++;
+    current_policy->on_access(frame_number);
+    if (frame_table[frame_number].prefetched) {
+        frame_table[frame_number].prefetched = 0;
+        readahead_state[frame_table[frame_number].process_id].hits++;
+    }
+}
+
+// Function to detect sequential or strided faults of a process and prefetch
+// the next pages of the stream. Called on a fault, before page_number is mapped.
+void readahead_for_fault(int process_id, int page_number, PageTable *pt) {
+    ReadaheadState *state = &readahead_state[process_id];
+    if (!readahead_enabled || current_policy->on_access == opt_on_access) {
+        return;  // OPT must only see demand references
+    }
+    if (state->window == 0) {
+        state->window = READAHEAD_INITIAL_WINDOW;
+        state->last_page = -1;
+    }
+
+    int continues = state->last_page != -1 && state->stride != 0 &&
+                    (page_number == state->next_expected || page_number - state->last_page == state->stride);
+    if (continues) {
+        if (page_number == state->next_expected && state->run >= READAHEAD_TRIGGER) {
+            // The previous batch was used up, so the stream deserves a bigger window
+            state->window = state->window * 2 > readahead_max_window ? readahead_max_window : state->window * 2;
+        }
+        state->run++;
+    } else {
+        int stride = state->last_page == -1 ? 0 : page_number - state->last_page;
+        state->stride = abs(stride) <= READAHEAD_MAX_STRIDE ? stride : 0;
+        state->run = state->stride != 0;
+    }
+    state->last_page = page_number;
+    state->next_expected = page_number + state->stride;
+    if (state->run < READAHEAD_TRIGGER) {
+        return;
+    }
+
+    // Prefetch up to window pages along the stream, skipping resident ones
+    int frames[READAHEAD_MAX_WINDOW];
+    int pages[READAHEAD_MAX_WINDOW];
+    int count = 0;
+    for (int i = 1; i <= state->window; i++) {
+        int target = page_number + i * state->stride;
+        if (target < 0 || target >= pt->num_entries) {
+            break;
+        }
+        PageTableEntry *entry = pt_lookup(pt, target);
+        if (entry != NULL && entry->valid) {
+            continue;
+        }
+        // Evicting a victim may free the leaf holding entry, so check it first
+        int swapped = page_swapped_out(entry);
+        if (!swapped && page_cache_map(process_id, target, pt) == 0) {
+            continue;  // Already in memory, so not counted as prefetched
+        }
+        int frame = obtain_frame(process_id, target);
+        if (frame == -1) {
+            break;
+        }
+        if (swapped) {
+            if (swap_in_page(process_id, target, frame) == -1) {
+                free_frame(frame);
+                continue;
+            }
+        } else {
+            pages[count] = target;
+            frames[count++] = frame;
+        }
+        pt_map_page(pt, target, frame);
+        current_policy->on_load(frame);
+        frame_table[frame].prefetched = 1;
+        state->pages_prefetched++;
+    }
+    state->next_expected = page_number + (state->window + 1) * state->stride;
+    state->batches++;
+
+    // Pages that come from the executable are read in one batch per contiguous run
+    for (int i = 0; i < count;) {
+        int run = 1;
+        while (i + run < count && pages[i + run] == pages[i] + run) {
+            run++;
+        }
+        load_pages_from_executable(process_id, pages[i], run, &frames[i]);
+        i += run;
+    }
+}
+
+// Function to display readahead counters per process and in total
+void show_readahead_stats() {
+    ReadaheadState total = {0};
+    printf("Readahead: %s, maximum window %d pages\n", readahead_enabled ? "on" : "off", readahead_max_window);
+    printf("  %7s %7s %7s %9s %11s %9s %9s %9s\n", "Process", "Window", "Stride", "Batches", "Prefetched", "Hits", "Waste", "Hit rate");
+    for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+        ReadaheadState *state = &readahead_state[process_id];
+        if (state->pages_prefetched == 0) {
+            continue;
+        }
+        printf("  %7d %7d %7d %9ld %11ld %9ld %9ld %8.2f%%\n", process_id, state->window, state->stride, state->batches,
+               state->pages_prefetched, state->hits, state->waste, 100.0 * state->hits / state->pages_prefetched);
+        total.batches += state->batches;
+        total.pages_prefetched += state->pages_prefetched;
+        total.hits += state->hits;
+        total.waste += state->waste;
+    }
+    printf("  %7s %7s %7s %9ld %11ld %9ld %9ld %8.2f%%\n", "Total", "", "", total.batches, total.pages_prefetched,
+           total.hits, total.waste, total.pages_prefetched ? 100.0 * total.hits / total.pages_prefetched : 0.0);
+}
+
+// Function to handle the readahead builtin
+void readahead_command(char **args) {
+    if (args[1] == NULL) {
+        show_readahead_stats();
+    } else if (strcmp(args[1], "on") == 0 || strcmp(args[1], "off") == 0) {
+        readahead_enabled = strcmp(args[1], "on") == 0;
+    } else if (strcmp(args[1], "reset") == 0) {
+        memset(readahead_state, 0, sizeof(readahead_state));
+    } else if (atoi(args[1]) >= 1 && atoi(args[1]) <= READAHEAD_MAX_WINDOW) {
+        readahead_max_window = atoi(args[1]);
+        for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+            if (readahead_state[process_id].window > readahead_max_window) {
+                readahead_state[process_id].window = readahead_max_window;
+            }
+        }
+    } else {
+        fprintf(stderr, "readahead: usage: readahead [on|off|reset|<max window 1-%d>]\n", READAHEAD_MAX_WINDOW);
+    }
+}
+
+// Function to check whether huge pages may be mapped. OPT must only see
+// the pages that are referenced, like with readahead.
+int huge_pages_usable() {
+    return huge_pages.enabled && current_policy->on_access != opt_on_access;
+}
+
+// Function to fault in a whole huge page. Only a leaf that maps nothing yet
+// qualifies, and only while a free 2 MB block is available; otherwise the
+// fault falls back to a single page. Returns 0 if the huge page was mapped.
+int huge_page_fault(int process_id, int page_number, PageTable *pt) {
+    int first_page = page_number & ~(HUGE_PAGE_FRAMES - 1);
+    if (!huge_pages_usable() || first_page + HUGE_PAGE_FRAMES > pt->num_entries ||
+        (pt->directory != NULL && pt->directory[page_number >> PT_LEAF_BITS] != NULL)) {
+        return -1;
+    }
+    int base = allocate_huge_frame(process_id, first_page);
+    if (base == -1) {
+        huge_pages.fallbacks++;
+        return -1;
+    }
+
+    current_policy->on_fault(process_id, page_number);
+    for (int i = 0; i < HUGE_PAGE_FRAMES; i++) {
+        load_page_from_executable(process_id, first_page + i, base + i);
+        pt_map_page(pt, first_page + i, base + i);
+        if (first_page + i != page_number) {
+            current_policy->on_load(base + i);
+        }
+    }
+    current_policy->on_load(base + (page_number - first_page));  // The faulting page is the most recent
+    pt->directory[page_number >> PT_LEAF_BITS]->huge_frame = base;
+    huge_pages.mapped++;
+    huge_pages.faults++;
+    if (pager_trace_level >= TRACE_EVENTS) {
+        printf("Mapped pages %d-%d of process %d as a huge page at frames %d-%d\n", first_page,
+               first_page + HUGE_PAGE_FRAMES - 1, process_id, base, base + HUGE_PAGE_FRAMES - 1);
+    }
+    return 0;
+}
+
+// Function to promote a fully populated leaf to a huge page. If its pages
+// already sit in order in an aligned 2 MB block they are promoted in place;
+// otherwise, if none is shared or being written back, they are copied into a
+// free block. Returns 0 if the leaf was promoted.
+int promote_leaf(int process_id, PageTable *pt, int leaf_index) {
+    PageTableLeaf *leaf = pt->directory != NULL ? pt->directory[leaf_index] : NULL;
+    if (leaf == NULL || leaf->huge_frame != -1 || leaf->resident_entries != PT_LEAF_SIZE) {
+        return -1;
+    }
+    int base = leaf->entries[0].frame_number;
+    int in_place = base % HUGE_PAGE_FRAMES == 0;
+    int movable = 1;
+    for (int i = 0; i < PT_LEAF_SIZE; i++) {
+        int frame = leaf->entries[i].frame_number;
+        in_place = in_place && frame == base + i;
+        movable = movable && frame_table[frame].map_count == 1 && !frame_table[frame].writeback;
+    }
+
+    int first_page = leaf_index * PT_LEAF_SIZE;
+    if (!in_place) {
+        if (!movable || (base = allocate_huge_frame(process_id, first_page)) == -1) {
+            return -1;
+        }
+        for (int i = 0; i < PT_LEAF_SIZE; i++) {
+            PageTableEntry *entry = &leaf->entries[i];
+            int old_frame = entry->frame_number;
+            int modified = entry->modified;
+            memcpy(frame_data(base + i), frame_data(old_frame), PAGE_SIZE);
+            frame_table[base + i].prefetched = frame_table[old_frame].prefetched;
+            frame_table[old_frame].prefetched = 0;  // Moved, not wasted
+            free_frame(old_frame);
+            pt_map_page(pt, first_page + i, base + i);
+            entry->modified = modified;
+            if (modified) {
+                dirty_queue_add(base + i);
+            }
+            current_policy->on_load(base + i);
+            tlb_shootdown(process_id, first_page + i);
+        }
+        huge_pages.collapses++;
+    }
+    leaf->huge_frame = base;
+    huge_pages.mapped++;
+    huge_pages.promotions++;
+    if (pager_trace_level >= TRACE_EVENTS) {
+        printf("Promoted pages %d-%d of process %d to a huge page at frames %d-%d\n", first_page,
+               first_page + PT_LEAF_SIZE - 1, process_id, base, base + PT_LEAF_SIZE - 1);
+    }
+    return 0;
+}
+
+// Function to promote every fully populated leaf of every process, returning the number promoted
+int promote_all_leaves() {
+    int promoted = 0;
+    for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+        PageTable *pt = &page_tables[process_id];
+        for (int dir = 0; pt->directory != NULL && dir < pt_directory_size(pt); dir++) {
+            promoted += promote_leaf(process_id, pt, dir) == 0;
+        }
+    }
+    return promoted;
+}
+
+// Function to display huge page usage and what it saved
+void show_huge_stats() {
+    int small_entries, huge_entries;
+    long reach = tlb_reach_kb(&small_entries, &huge_entries);
+    printf("Huge pages: %s, %d KB each (%d frames)\n", huge_pages.enabled ? "on" : "off", HUGE_PAGE_FRAMES * PAGE_SIZE / 1024,
+           HUGE_PAGE_FRAMES);
+    printf("  Mapped:           %ld (%ld KB)\n", huge_pages.mapped, huge_pages.mapped * HUGE_PAGE_FRAMES * PAGE_SIZE / 1024);
+    printf("  Free blocks:      %d of %d\n", free_huge_frame_count(), HUGE_FRAME_BLOCKS);
+    printf("  Huge faults:      %ld, saving %ld 4 KB faults\n", huge_pages.faults, huge_pages.faults * (HUGE_PAGE_FRAMES - 1));
+    printf("  Fallbacks:        %ld faults found no free block\n", huge_pages.fallbacks);
+    printf("  Promotions:       %ld (%ld by copying)\n", huge_pages.promotions, huge_pages.collapses);
+    printf("  Demotions:        %ld\n", huge_pages.demotions);
+    printf("  TLB huge hits:    %ld of %ld hits\n", tlb.huge_hits, tlb.hits);
+    printf("  TLB reach:        %ld KB now, up to %ld KB with every entry in use\n", reach,
+           ((long)tlb.num_entries + (long)TLB_HUGE_ENTRIES * HUGE_PAGE_FRAMES) * PAGE_SIZE / 1024);
+}
+
+// Function to handle the huge builtin
+void huge_command(char **args) {
+    if (args[1] == NULL) {
+        show_huge_stats();
+    } else if (strcmp(args[1], "on") == 0 || strcmp(args[1], "off") == 0) {
+        huge_pages.enabled = strcmp(args[1], "on") == 0;  // Huge pages already mapped stay mapped
+    } else if (strcmp(args[1], "promote") == 0) {
+        printf("Promoted %d leaves to huge pages\n", promote_all_leaves());
+    } else if (strcmp(args[1], "reset") == 0) {
+        huge_pages.faults = 0;
+        huge_pages.fallbacks = 0;
+        huge_pages.promotions = 0;
+        huge_pages.collapses = 0;
+        huge_pages.demotions = 0;
+    } else {
+        fprintf(stderr, "huge: usage: huge [on|off|promote|reset]\n");
+    }
+}
+
+// Function to get the memory available to processes, in frames
+long usable_frames() {
+    return num_frames - buddy.shell_frames;
+}
+
+// Function to get the commit limit in strict mode: swap plus the configured
+// share of memory, in pages
+long commit_limit() {
+    return SWAP_SLOTS + usable_frames() * overcommit.ratio / 100;
+}
+
+// Function to check whether the overcommit mode admits reserving more pages
+int commit_allowed(long pages) {
+    if (overcommit.mode == OVERCOMMIT_ALWAYS) {
+        return 1;
+    } else if (overcommit.mode == OVERCOMMIT_HEURISTIC) {
+        return pages <= usable_frames() + SWAP_SLOTS;
+    }
+    return overcommit.committed_pages + pages <= commit_limit();
+}
+
+// Function to charge pages a process reserves against the commit. Returns
+// -1, counting a refusal, if the overcommit mode does not admit them.
+int commit_pages(int process_id, long pages) {
+    if (!commit_allowed(pages)) {
+        overcommit.refusals++;
+        return -1;
+    }
+    overcommit.process_pages[process_id] += pages;
+    overcommit.committed_pages += pages;
+    return 0;
+}
+
+// Function to release every page a process reserved
+void uncommit_process(int process_id) {
+    overcommit.committed_pages -= overcommit.process_pages[process_id];
+    overcommit.process_pages[process_id] = 0;
+}
+
+// Function to display the overcommit mode and the pages committed
+void show_overcommit() {
+    printf("Overcommit: %s, ratio %d%%\n", overcommit_mode_names[overcommit.mode], overcommit.ratio);
+    printf("  Committed:        %ld pages (%ld KB)\n", overcommit.committed_pages, overcommit.committed_pages * PAGE_SIZE / 1024);
+    printf("  Commit limit:     %ld pages (%ld KB)%s\n", commit_limit(), commit_limit() * PAGE_SIZE / 1024,
+           overcommit.mode == OVERCOMMIT_NEVER ? "" : ", enforced in never mode only");
+    printf("  Refusals:         %ld\n", overcommit.refusals);
+}
+
+// Function to handle the overcommit builtin
+void overcommit_command(char **args) {
+    lock_pager();
+    if (args[1] == NULL) {
+        show_overcommit();
+        unlock_pager();
+        return;
+    }
+    int mode = -1;
+    for (int i = OVERCOMMIT_HEURISTIC; i <= OVERCOMMIT_NEVER; i++) {
+        if (strcmp(args[1], overcommit_mode_names[i]) == 0) {
+            mode = i;
+        }
+    }
+    if (strcmp(args[1], "reset") == 0) {
+        overcommit.refusals = 0;
+    } else if (mode != -1 && (args[2] == NULL || (atoi(args[2]) >= 0 && atoi(args[2]) <= 100))) {
+        overcommit.mode = mode;  // Reservations already made are kept even if they now exceed the limit
+        if (args[2] != NULL) {
+            overcommit.ratio = atoi(args[2]);
+        }
+    } else {
+        fprintf(stderr, "overcommit: usage: overcommit [heuristic|always|never [<ratio%%>]|reset]\n");
+    }
+    unlock_pager();
+}
+
+// Function to get the number of frames the pager can still hand out: the
+// free frames and every resident page except the dirty ones that would find
+// no free swap slot to be written to
+long oom_available_frames() {
+    long resident = usable_frames() - free_frame_count;
+    long free_slots = SWAP_SLOTS - swap_slots_used;
+    long stuck = dirty_frame_count > free_slots ? dirty_frame_count - free_slots : 0;
+    return free_frame_count + resident - stuck;
+}
+
+// Function to get the threshold below which the OOM killer runs, in frames
+long oom_min_frames() {
+    long frames = usable_frames() * oom_killer.min_percent / 100;
+    return frames > 0 ? frames : 1;
+}
+
+// Function to check whether memory has run out. Cheap enough to call on
+// every fault: while frames are free it is a single comparison.
+int out_of_memory() {
+    return oom_killer.enabled && free_frame_count < oom_min_frames() && oom_available_frames() < oom_min_frames();
+}
+
+// Function to count the pages of a process that are in swap or the
+// compressed pool rather than resident
+long swapped_page_count(int process_id) {
+    PageTable *pt = &page_tables[process_id];
+    long swapped = 0;
+    for (int dir = 0; pt->directory != NULL && dir < pt_directory_size(pt); dir++) {
+        for (int i = 0; pt->directory[dir] != NULL && i < PT_LEAF_SIZE; i++) {
+            PageTableEntry *entry = &pt->directory[dir]->entries[i];
+            swapped += !entry->valid && (entry->swap_slot != -1 || entry->zswap_entry != -1);
+        }
+    }
+    return swapped;
+}
+
+// Function to score a process for the OOM killer: its resident and swapped
+// pages, plus its adjustment in thousandths of memory and swap. Returns -1
+// for a process that does not exist or must not be killed.
+long oom_badness(int process_id) {
+    if (page_tables[process_id].num_entries == 0 || oom_killer.score_adj[process_id] == OOM_SCORE_ADJ_MIN) {
+        return -1;
+    }
+    long points = page_tables[process_id].resident_pages + swapped_page_count(process_id);
+    points += (long)oom_killer.score_adj[process_id] * (usable_frames() + SWAP_SLOTS) / 1000;
+    return points > 0 ? points : 1;  // Adjustments can make a process unlikely but not exempt
+}
+
+// Function to terminate the process with the highest OOM score, freeing its
+// frames and swap. Returns its process ID, -1 if every process is protected.
+int oom_kill() {
+    int victim = -1;
+    long victim_points = -1;
+    for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+        long points = oom_badness(process_id);
+        if (points > victim_points) {
+            victim = process_id;
+            victim_points = points;
+        }
+    }
+    if (victim == -1) {
+        return -1;
+    }
+    int resident = page_tables[victim].resident_pages;
+    long swapped = swapped_page_count(victim);
+    fprintf(stderr, "Out of memory: killed process %d (score %ld, %d resident pages, %ld swapped pages)\n", victim,
+            victim_points, resident, swapped);
+    oom_killer.kills++;
+    oom_killer.pages_freed += resident + swapped;
+    terminate_process(page_tables, victim);
+    return victim;
+}
+
+// Function to display the OOM killer's state and the score of every process
+void show_oom_killer() {
+    printf("OOM killer: %s, threshold %d%% (%ld frames), %ld frames available now\n", oom_killer.enabled ? "on" : "off",
+           oom_killer.min_percent, oom_min_frames(), oom_available_frames());
+    printf("  Kills:            %ld, freeing %ld pages\n", oom_killer.kills, oom_killer.pages_freed);
+    printf("  %5s %10s %9s %9s %6s %9s\n", "PID", "Committed", "RSS", "Swapped", "Adj", "Score");
+    for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+        if (page_tables[process_id].num_entries == 0) {
+            continue;
+        }
+        long points = oom_badness(process_id);
+        printf("  %5d %10ld %9d %9ld %6d ", process_id, overcommit.process_pages[process_id],
+               page_tables[process_id].resident_pages, swapped_page_count(process_id), oom_killer.score_adj[process_id]);
+        if (points == -1) {
+            printf("%9s\n", "never");
+        } else {
+            printf("%9ld\n", points);
+        }
+    }
+}
+
+// Function to handle the oom builtin
+void oom_command(char **args) {
+    lock_pager();
+    if (args[1] == NULL) {
+        show_oom_killer();
+    } else if (strcmp(args[1], "on") == 0 || strcmp(args[1], "off") == 0) {
+        oom_killer.enabled = strcmp(args[1], "on") == 0;
+    } else if (strcmp(args[1], "kill") == 0) {
+        if (oom_kill() == -1) {
+            fprintf(stderr, "oom: every process is protected\n");
+        }
+    } else if (strcmp(args[1], "reset") == 0) {
+        oom_killer.kills = 0;
+        oom_killer.pages_freed = 0;
+    } else if (strcmp(args[1], "adj") == 0 && args[2] != NULL && args[3] != NULL) {
+        int process_id = atoi(args[2]);
+        int adj = atoi(args[3]);
+        if (process_id < 0 || process_id >= MAX_PROCESSES || page_tables[process_id].num_entries == 0) {
+            fprintf(stderr, "oom: process %s does not exist\n", args[2]);
+        } else if (adj < OOM_SCORE_ADJ_MIN || adj > OOM_SCORE_ADJ_MAX) {
+            fprintf(stderr, "oom: adjustment must be between %d and %d\n", OOM_SCORE_ADJ_MIN, OOM_SCORE_ADJ_MAX);
+        } else {
+            oom_killer.score_adj[process_id] = adj;
+        }
+    } else if (atoi(args[1]) > 0 && atoi(args[1]) <= 100) {
+        oom_killer.min_percent = atoi(args[1]);
+    } else {
+        fprintf(stderr, "oom: usage: oom [on|off|kill|reset|adj <pid> <adjustment>|<min%%>]\n");
+    }
+    unlock_pager();
+}
+
+// Function to count a fault as major if the page was read from its file or
+// the swap file, and as minor if it was zero-filled, decompressed or found
+// in the page cache
+void count_fault(int process_id, int page_number, int tier) {
+    long file_page;
+    if (tier == FAULT_TIER_SWAP || (tier == FAULT_TIER_FILL && page_backing_file(process_id, page_number, &file_page) != -1)) {
+        major_faults++;
+    } else {
+        minor_faults++;
+    }
+}
+
+// Function to handle a page fault. Returns 0 if the page was mapped, -1 if
+// no frame could be had for it or its compressed copy was corrupt.
+int handle_page_fault(int process_id, int page_number, PageTable *pt) {
+    long start = now_nanoseconds();
+    ReplacementPolicy *policy = current_policy;
+    policy->faults++;
+    int tier = FAULT_TIER_FILL;
+    if (huge_page_fault(process_id, page_number, pt) != 0) {
+        // Prefetch before taking a frame for the faulting page, so that the
+        // evictions readahead causes can never take the page being faulted in
+        readahead_for_fault(process_id, page_number, pt);
+        int swapped = page_swapped_out(pt_lookup(pt, page_number));
+        if (!swapped && page_cache_map(process_id, page_number, pt) == 0) {
+            tier = FAULT_TIER_CACHE;  // Another mapping of the file page has it in memory
+        } else {
+            policy->on_fault(process_id, page_number);
+            int frame = obtain_frame(process_id, page_number);
+            if (frame == -1) {
+                fprintf(stderr, "Out of memory: no frame can be freed for page %d of process %d\n", page_number, process_id);
+                return -1;
+            }
+
+            // Bring the page in from the compressed pool or swap if it was swapped out, else from its file
+            if (swapped) {
+                tier = swap_in_page(process_id, page_number, frame);
+                if (tier == -1) {
+                    free_frame(frame);
+                    return -1;
+                }
+            } else {
+                load_page_from_executable(process_id, page_number, frame);
+                page_cache_insert(process_id, page_number, frame);
+            }
+            pt_map_page(pt, page_number, frame);
+            policy->on_load(frame);
+        }
+        if (huge_pages_usable()) {
+            promote_leaf(process_id, pt, page_number >> PT_LEAF_BITS);  // The fault may have completed its leaf
+        }
+    }
+    count_fault(process_id, page_number, tier);
+    long elapsed = now_nanoseconds() - start;
+    record_latency(&fault_latency, elapsed);
+    record_latency(&tier_latency[tier], elapsed);
+    return 0;
+}
+
+// Function to reference a page of a process, faulting it in if it is not
+// resident. Returns 0 if the page was referenced, -1 if it is outside the
+// address space, the OOM killer terminated the process or no frame could be
+// had for the fault. The caller must hold pager_lock.
+int reference_page(int process_id, int page_number, PageTable *pt) {
+    if (page_number < 0 || page_number >= pt->num_entries) {
+        fprintf(stderr, "Page %d is outside the address space of process %d\n", page_number, process_id);
+        return -1;
+    }
+    if (load_control_usable() && load_control.references >= working_set_estimate_interval()) {
+        estimate_working_sets(1);  // Before the reference, since suspending a process swaps it out
+    }
+
+    int frame = tlb.enabled ? tlb_lookup(process_id, page_number) : -1;
+    int faulted = 0;
+    if (frame != -1) {
+        note_page_hit(frame);
+    } else {
+        // TLB miss: walk the directory and, unless it maps a huge page, the leaf
+        PageTableEntry *entry = pt_lookup(pt, page_number);
+        PageTableLeaf *leaf = pt->directory != NULL ? pt->directory[page_number >> PT_LEAF_BITS] : NULL;
+        tlb.walks++;
+        tlb.walk_references += leaf != NULL && leaf->huge_frame == -1 ? 2 : 1;
+        if (entry != NULL && entry->valid) {
+            note_page_hit(entry->frame_number);
+        } else {
+            if (out_of_memory() && oom_kill() == process_id) {
+                return -1;  // The faulting process was chosen to free memory
+            }
+            if (handle_page_fault(process_id, page_number, pt) != 0) {
+                return -1;
+            }
+            entry = pt_lookup(pt, page_number);
+            leaf = pt->directory[page_number >> PT_LEAF_BITS];
+            faulted = 1;
+        }
+        if (tlb.enabled && leaf->huge_frame != -1) {
+            tlb_insert_huge(process_id, page_number & ~(HUGE_PAGE_FRAMES - 1), leaf->huge_frame);
+        } else if (tlb.enabled) {
+            tlb_insert(process_id, page_number, entry->frame_number);
+        }
+        frame = entry->frame_number;
+    }
+    policy_clock++;
+    note_working_set_reference(process_id, frame, faulted);
+    return 0;
+}
+
+// Function to check if a write to a resident page needs the pager: the first
+// write sets the dirty bit, and a write to a shared frame needs a private copy
+int write_needs_pager(PageTableEntry *entry) {
+    return !entry->modified || frame_table[entry->frame_number].map_count > 1;
+}
+
+// Function to access a virtual address of a process the way a load
+// (is_write 0) or a store (1) would. A hit sets the frame's referenced bit;
+// a store also sets the page's dirty bit. A resident page whose dirty bit is
+// already right takes the hit path of reference_page(); anything else faults
+// the page in or handles the first write. Returns 1 if the access faulted,
+// 0 if it hit, -1 if the address is outside the process's address space,
+// the OOM killer terminated the process or no frame could be had for the
+// page. The caller must hold pager_lock.
+int pager_access(int process_id, uint64_t vaddr, int is_write) {
+    if (process_id < 0 || process_id >= MAX_PROCESSES || vaddr >= (uint64_t)page_tables[process_id].num_entries * PAGE_SIZE) {
+        return -1;
+    }
+    PageTable *pt = &page_tables[process_id];
+    int page_number = (int)(vaddr / PAGE_SIZE);
+    long faults = current_policy->faults;
+    if (reference_page(process_id, page_number, pt) != 0 || pt->num_entries == 0) {
+        return -1;
+    }
+    if (is_write && write_needs_pager(pt_lookup(pt, page_number))) {
+        mark_page_dirty(process_id, page_number);
+    }
+    return current_policy->faults != faults;
+}
+
+// Function to run a batch of accesses, taking the pager lock once for all of
+// them. Accesses outside their process's address space are skipped.
+// Returns the number of accesses that faulted.
+long pager_access_batch(const PageAccess *accesses, long count) {
+    long faults = 0;
+    lock_pager();
+    for (long i = 0; i < count; i++) {
+        faults += pager_access(accesses[i].process_id, accesses[i].vaddr, accesses[i].is_write) == 1;
+    }
+    unlock_pager();
+    return faults;
+}
+
+// Function to apply the policy updates a fault worker queued. Called with
+// pager_lock held, or from inside the fault gate with policy_lock held.
+void drain_fault_batch(FaultWorker *worker) {
+    for (int i = 0; i < worker->batched; i++) {
+        int frame = worker->batch[i];
+        note_working_set_reference(worker->process_id, frame, worker->batch_kind[i] != FAULT_BATCH_HIT);
+        if (worker->batch_kind[i] == FAULT_BATCH_HIT) {
+            note_page_hit(frame);
+        } else {
+            current_policy->faults++;
+            count_fault(frame_table[frame].process_id, frame_table[frame].page_number, FAULT_TIER_FILL);
+            current_policy->on_fault(frame_table[frame].process_id, frame_table[frame].page_number);
+            current_policy->on_load(frame);
+            if (worker->batch_kind[i] == FAULT_BATCH_DIRTY_FAULT) {
+                dirty_queue_add(frame);
+            }
+        }
+        policy_clock++;
+    }
+    worker->batched = 0;
+    if (cleaner.running && dirty_frame_count > cleaner_high_frames()) {
+        pthread_cond_signal(&cleaner_wakeup);
+    }
+}
+
+// Function to queue a policy update, applying the batch once it is full
+void queue_policy_update(FaultWorker *worker, int frame_number, int kind) {
+    if (worker->batched == FAULT_BATCH_SIZE) {
+        pthread_mutex_lock(&policy_lock);
+        drain_fault_batch(worker);
+        pthread_mutex_unlock(&policy_lock);
+    }
+    worker->batch[worker->batched] = frame_number;
+    worker->batch_kind[worker->batched++] = kind;
+}
+
+// Function to take a free frame from a worker's cache, refilling the cache
+// from the buddy allocator when it is empty. Returns -1 if no frame is free.
+int worker_take_frame(FaultWorker *worker) {
+    if (worker->cached == 0) {
+        pthread_mutex_lock(&zone_lock);
+        while (worker->cached < FRAME_CACHE_SIZE) {
+            int frame = buddy_allocate(0);
+            if (frame == -1) {
+                break;
+            }
+            worker->frames[worker->cached++] = frame;
+        }
+        pthread_mutex_unlock(&zone_lock);
+    }
+    return worker->cached > 0 ? worker->frames[--worker->cached] : -1;
+}
+
+// Function to try a reference from inside the fault gate, holding only the
+// page table's lock. Handles hits that need no copy-on-write or other work,
+// and faults on pages that were never swapped out while a free frame is at
+// hand. Returns 1 if the reference was handled, 0 if it needs pager_lock.
+int try_fast_reference(FaultWorker *worker, int process_id, int page_number, int is_write) {
+    PageTable *pt = &page_tables[process_id];
+    PageTableEntry *entry = pt_lookup(pt, page_number);
+    if (entry != NULL && entry->valid) {
+        if (is_write && write_needs_pager(entry)) {
+            return 0;  // Dirtying a page may need a private copy or drop a compressed one
+        }
+        queue_policy_update(worker, entry->frame_number, FAULT_BATCH_HIT);
+        return 1;
+    }
+    long file_page;
+    if (page_swapped_out(entry) || huge_pages_usable() || current_policy->on_access == opt_on_access ||
+        !process_resources[process_id].executable_mapped) {
+        return 0;  // Mapping the image updates mapped_files, which needs pager_lock too
+    }
+    if (page_cache_usable(process_id) && page_backing_file(process_id, page_number, &file_page) != -1) {
+        return 0;  // File pages go through the page cache
+    }
+
+    long start = now_nanoseconds();
+    int frame = worker_take_frame(worker);
+    if (frame == -1) {
+        return 0;  // Out of free frames, so a victim has to be evicted
+    }
+    set_frame_owner(frame, process_id, page_number);
+    frame_table[frame].map_count = 1;
+    frame_last_reference[frame] = working_sets[process_id].virtual_time;
+    load_page_from_executable(process_id, page_number, frame);
+    pt_map_page(pt, page_number, frame);
+    pt_lookup(pt, page_number)->modified = is_write;
+    queue_policy_update(worker, frame, is_write ? FAULT_BATCH_DIRTY_FAULT : FAULT_BATCH_FAULT);
+    worker->fast_faults++;
+    record_latency(&worker->fault_latency, now_nanoseconds() - start);
+    return 1;
+}
+
+// Function to reference a page from a fault worker. Ordinary faults run
+// concurrently with other workers; the rest take the pager lock.
+void worker_reference_page(FaultWorker *worker, int process_id, int page_number, int is_write) {
+    PageTable *pt = &page_tables[process_id];
+    if (!worker->use_pager_lock) {
+        enter_fault_gate(worker);
+        pthread_mutex_lock(&pt->lock);
+        int handled = try_fast_reference(worker, process_id, page_number, is_write);
+        pthread_mutex_unlock(&pt->lock);
+        leave_fault_gate(worker);
+        if (handled) {
+            return;
+        }
+    }
+    lock_pager();
+    pager_access(process_id, (uint64_t)page_number * PAGE_SIZE, is_write);
+    unlock_pager();
+    worker->slow_references++;
+}
+
+// Function to add a histogram's samples to another
+void merge_latency(LatencyHistogram *into, const LatencyHistogram *from) {
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        into->buckets[i] += from->buckets[i];
+    }
+    into->count += from->count;
+    into->total_ns += from->total_ns;
+}
+
+// Function run by each fault benchmark thread: it writes every page of its
+// process once, so every reference is a first-touch fault
+void *fault_worker_thread(void *arg) {
+    FaultWorker *worker = arg;
+    for (int page = 0; page < worker->pages; page++) {
+        worker_reference_page(worker, worker->process_id, page, 1);
+    }
+    return NULL;
+}
+
+// Function to run the fault benchmark with 1, 2, 4, ... up to max_threads
+// threads, each faulting in pages of a process of its own, and report the
+// fault throughput. Called without pager_lock held.
+void fault_benchmark(int max_threads, int pages, int use_pager_lock) {
+    int first_process = MAX_PROCESSES - FAULT_MAX_WORKERS;
+    lock_pager();
+    for (int process_id = first_process; process_id < first_process + max_threads; process_id++) {
+        if (page_tables[process_id].num_entries != 0) {
+            fprintf(stderr, "faultbench: processes %d-%d must not exist\n", first_process, first_process + max_threads - 1);
+            unlock_pager();
+            return;
+        }
+    }
+    if (!commit_allowed((long)max_threads * pages)) {
+        fprintf(stderr, "faultbench: cannot commit %ld pages under overcommit mode %s\n", (long)max_threads * pages,
+                overcommit_mode_names[overcommit.mode]);
+        unlock_pager();
+        return;
+    }
+    // Without readahead every page is a fault of its own in both modes
+    int trace_level = pager_trace_level;
+    int readahead = readahead_enabled;
+    pager_trace_level = TRACE_OFF;
+    readahead_enabled = 0;
+    unlock_pager();
+
+    printf("Fault benchmark: %d pages per thread, %s, %ld CPUs online\n", pages,
+           use_pager_lock ? "pager lock for every fault" : "concurrent faults", sysconf(_SC_NPROCESSORS_ONLN));
+    printf("  %7s %10s %9s %12s %8s %10s\n", "Threads", "Faults", "Seconds", "Faults/s", "Speedup", "Slow path");
+    double base_rate = 0;
+    for (int threads = 1;; threads = threads * 2 < max_threads ? threads * 2 : max_threads) {
+        lock_pager();
+        for (int i = 0; i < threads; i++) {
+            FaultWorker *worker = &fault_workers[i];
+            memset(worker, 0, sizeof(*worker));
+            worker->process_id = first_process + i;
+            worker->pages = pages;
+            worker->use_pager_lock = use_pager_lock;
+            init_page_table(&page_tables[worker->process_id], pages);
+            map_process_image(worker->process_id);  // Mapping it updates mapped_files, which needs pager_lock
+            commit_pages(worker->process_id, pages);  // Admitted above
+            oom_killer.score_adj[worker->process_id] = OOM_SCORE_ADJ_MIN;  // Its worker faults outside pager_lock
+        }
+        fault_worker_count = threads;
+        unlock_pager();
+
+        double start = now_seconds();
+        int started = 0;
+        while (started < threads && pthread_create(&fault_workers[started].thread, NULL, fault_worker_thread, &fault_workers[started]) == 0) {
+            started++;
+        }
+        if (started < threads) {
+            perror("Error starting fault worker");
+        }
+        for (int i = 0; i < started; i++) {
+            pthread_join(fault_workers[i].thread, NULL);
+        }
+        double elapsed = now_seconds() - start;
+
+        // Apply the last queued updates, return the cached frames and tear down the processes
+        lock_pager();
+        long faults = 0;
+        long slow = 0;
+        for (int i = 0; i < threads; i++) {
+            FaultWorker *worker = &fault_workers[i];
+            while (worker->cached > 0) {
+                buddy_free(worker->frames[--worker->cached], 0);
+            }
+            merge_latency(&fault_latency, &worker->fault_latency);
+            merge_latency(&tier_latency[FAULT_TIER_FILL], &worker->fault_latency);
+            faults += i < started ? pages : 0;
+            slow += worker->slow_references;
+        }
+        fault_worker_count = 0;
+        for (int i = 0; i < threads; i++) {
+            release_process_memory(page_tables, first_process + i);
+            unmap_process_image(first_process + i);
+        }
+        unlock_pager();
+
+        double rate = elapsed > 0 ? faults / elapsed : 0;
+        if (threads == 1) {
+            base_rate = rate;
+        }
+        printf("  %7d %10ld %9.3f %12.0f %7.2fx %9.2f%%\n", threads, faults, elapsed, rate, base_rate > 0 ? rate / base_rate : 0,
+               faults ? 100.0 * slow / faults : 0.0);
+        if (threads == max_threads) {
+            break;
+        }
+    }
+    lock_pager();
+    pager_trace_level = trace_level;
+    readahead_enabled = readahead;
+    unlock_pager();
+}
+
+// Structure representing the live pager. A region of the shell's own memory
+// is registered with userfaultfd, and a handler thread serves its missing-page
+// faults as faults of LIVE_PROCESS_ID. The frame holding a page is copied into
+// the region, and an evicted page is dropped from the region with
+// MADV_DONTNEED, so the region never holds more pages than the pager has frames.
+typedef struct {
+    int uffd;
+    char *region;  // NULL unless a live run is in progress
+    int pages;
+    char *mapped;  // 1 for each page currently mapped in the region
+    int stop_pipe[2];  // Written to when the handler thread should exit
+    pthread_t thread;
+    long real_faults;  // Faults the kernel reported on the region
+    long evictions;
+    long dirty_evictions;  // Evictions of pages the workload had written
+    int peak_resident;
+    LatencyHistogram latency;  // Time to serve a real fault
+} LivePager;
+
+LivePager live_pager = {.uffd = -1};
+
+// Function to check if a frame holds a page of the live region. Their frames
+// are stale while the page is mapped, so the merger must not compare them.
+int live_pager_frame(int frame_number) {
+    return live_pager.region != NULL && frame_table[frame_number].process_id == LIVE_PROCESS_ID;
+}
+
+// Function to drop an evicted page from the live region. Called before the
+// victim is written out: while the page is mapped the region has its current
+// contents, so they are copied back into the frame first. A page that no
+// longer matches its frame was written and is evicted dirty. The workload is
+// blocked on the fault being served, so the page cannot change meanwhile.
+void live_pager_evict(int process_id, int page_number, int frame_number) {
+    if (live_pager.region == NULL || process_id != LIVE_PROCESS_ID || !live_pager.mapped[page_number]) {
+        return;
+    }
+    char *page = live_pager.region + (size_t)page_number * PAGE_SIZE;
+    if (memcmp(page, frame_data(frame_number), PAGE_SIZE) != 0) {
+        memcpy(frame_data(frame_number), page, PAGE_SIZE);
+        pt_lookup(&page_tables[process_id], page_number)->modified = 1;
+        live_pager.dirty_evictions++;
+    }
+    if (madvise(page, PAGE_SIZE, MADV_DONTNEED) == -1) {
+        perror("live: Error dropping page");
+    }
+    live_pager.mapped[page_number] = 0;
+    live_pager.evictions++;
+}
+
+// Function to serve a missing-page fault on the live region: reference the
+// page through the pager, faulting it in if needed, and copy its frame into
+// the region, which also wakes the faulting thread
+void live_pager_serve(unsigned long address) {
+    long start = now_nanoseconds();
+    int page_number = (int)((address - (unsigned long)live_pager.region) / PAGE_SIZE);
+    PageTable *pt = &page_tables[LIVE_PROCESS_ID];
+    lock_pager();
+    if (reference_page(LIVE_PROCESS_ID, page_number, pt) != 0) {
+        // Wake the workload with a zero page rather than leave it blocked; its checks report the loss
+        struct uffdio_zeropage zero = {.range = {.start = (unsigned long)live_pager.region + (unsigned long)page_number * PAGE_SIZE,
+                                                 .len = PAGE_SIZE}};
+        if (ioctl(live_pager.uffd, UFFDIO_ZEROPAGE, &zero) == -1 && errno != EEXIST) {
+            perror("live: Error mapping page");
+        }
+        unlock_pager();
+        return;
+    }
+    struct uffdio_copy copy = {
+        .dst = (unsigned long)live_pager.region + (unsigned long)page_number * PAGE_SIZE,
+        .src = (unsigned long)frame_data(pt_lookup(pt, page_number)->frame_number),
+        .len = PAGE_SIZE,
+    };
+    if (ioctl(live_pager.uffd, UFFDIO_COPY, &copy) == -1 && errno != EEXIST) {
+        perror("live: Error mapping page");
+    }
+    live_pager.mapped[page_number] = 1;
+    live_pager.real_faults++;
+    if (pt->resident_pages > live_pager.peak_resident) {
+        live_pager.peak_resident = pt->resident_pages;
+    }
+    record_latency(&live_pager.latency, now_nanoseconds() - start);
+    unlock_pager();
+}
+
+// Function run by the live pager's handler thread
+void *live_pager_thread(void *arg) {
+    (void)arg;
+    struct pollfd fds[2] = {{.fd = live_pager.uffd, .events = POLLIN}, {.fd = live_pager.stop_pipe[0], .events = POLLIN}};
+    while (poll(fds, 2, -1) != -1 || errno == EINTR) {
+        if (fds[1].revents != 0) {
+            break;
+        }
+        struct uffd_msg message;
+        if (fds[0].revents == 0 || read(live_pager.uffd, &message, sizeof(message)) != sizeof(message)) {
+            continue;
+        }
+        if (message.event == UFFD_EVENT_PAGEFAULT) {
+            live_pager_serve(message.arg.pagefault.address);
+        }
+    }
+    return NULL;
+}
+
+// Function to open a userfaultfd and register the live region with it.
+// Returns 0 on success, -1 with errno set if the kernel refuses.
+int live_pager_register() {
+#ifdef SYS_userfaultfd
+    int flags = O_CLOEXEC | O_NONBLOCK;
+#ifdef UFFD_USER_MODE_ONLY
+    // Faults from user mode are all the pager serves, and unprivileged users may only ask for those
+    live_pager.uffd = syscall(SYS_userfaultfd, flags | UFFD_USER_MODE_ONLY);
+    if (live_pager.uffd == -1 && errno == EINVAL) {
+        live_pager.uffd = syscall(SYS_userfaultfd, flags);  // Kernel older than the flag
+    }
+#else
+    live_pager.uffd = syscall(SYS_userfaultfd, flags);
+#endif
+    if (live_pager.uffd == -1) {
+        return -1;
+    }
+    struct uffdio_api api = {.api = UFFD_API};
+    struct uffdio_register region = {
+        .range = {.start = (unsigned long)live_pager.region, .len = (unsigned long)live_pager.pages * PAGE_SIZE},
+        .mode = UFFDIO_REGISTER_MODE_MISSING,
+    };
+    if (ioctl(live_pager.uffd, UFFDIO_API, &api) == -1 || ioctl(live_pager.uffd, UFFDIO_REGISTER, &region) == -1) {
+        int error = errno;
+        close(live_pager.uffd);
+        live_pager.uffd = -1;
+        errno = error;
+        return -1;
+    }
+    return 0;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+// Function to run a workload on memory served by the pager. The workload
+// walks the live region in passes, sequentially or in random order, writing
+// every fourth access and checking every other access against the last value
+// written. Resident memory is bounded by the pager's frames, so start the
+// shell with a small -m to put the region under pressure.
+void live_pager_run(int pages, int passes, int random_order) {
+    lock_pager();
+    if (page_tables[LIVE_PROCESS_ID].num_entries != 0) {
+        fprintf(stderr, "live: process %d must not exist\n", LIVE_PROCESS_ID);
+        unlock_pager();
+        return;
+    }
+    unlock_pager();
+
+    char *region = mmap(NULL, (size_t)pages * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED) {
+        perror("live: Error mapping region");
+        return;
+    }
+    memset(&live_pager, 0, sizeof(live_pager));
+    live_pager.region = region;
+    live_pager.pages = pages;
+    if (live_pager_register() != 0) {
+        fprintf(stderr, "live: userfaultfd is unavailable: %s\n", strerror(errno));
+        if (errno == EPERM) {
+            fprintf(stderr, "live: allow it with sysctl vm.unprivileged_userfaultfd=1 or access to /dev/userfaultfd\n");
+        }
+        munmap(region, (size_t)pages * PAGE_SIZE);
+        live_pager.region = NULL;
+        live_pager.uffd = -1;
+        return;
+    }
+    long *expected = calloc(pages, sizeof(long));
+    live_pager.mapped = calloc(pages, 1);
+    if (expected == NULL || live_pager.mapped == NULL || pipe(live_pager.stop_pipe) == -1) {
+        perror("live: Error setting up");
+        free(expected);
+        free(live_pager.mapped);
+        close(live_pager.uffd);
+        munmap(region, (size_t)pages * PAGE_SIZE);
+        live_pager.region = NULL;
+        live_pager.uffd = -1;
+        return;
+    }
+
+    lock_pager();
+    if (commit_pages(LIVE_PROCESS_ID, pages) != 0) {
+        fprintf(stderr, "live: cannot commit %d pages under overcommit mode %s\n", pages, overcommit_mode_names[overcommit.mode]);
+        unlock_pager();
+        free(expected);
+        free(live_pager.mapped);
+        close(live_pager.stop_pipe[0]);
+        close(live_pager.stop_pipe[1]);
+        close(live_pager.uffd);
+        munmap(region, (size_t)pages * PAGE_SIZE);
+        live_pager.region = NULL;
+        live_pager.uffd = -1;
+        return;
+    }
+    int trace_level = pager_trace_level;
+    pager_trace_level = TRACE_OFF;
+    init_page_table(&page_tables[LIVE_PROCESS_ID], pages);
+    oom_killer.score_adj[LIVE_PROCESS_ID] = OOM_SCORE_ADJ_MIN;  // The handler thread serves its faults
+    long pager_faults = current_policy->faults;
+    unlock_pager();
+
+    if (pthread_create(&live_pager.thread, NULL, live_pager_thread, NULL) != 0) {
+        perror("live: Error starting handler thread");
+    } else {
+        long accesses = (long)pages * passes;
+        long corrupted = 0;
+        long value = 0;
+        unsigned int seed = 1;
+        double start = now_seconds();
+        for (long i = 0; i < accesses; i++) {
+            int page_number = random_order ? (int)(rand_r(&seed) % pages) : (int)(i % pages);
+            volatile long *word = (volatile long *)(region + (size_t)page_number * PAGE_SIZE);
+            if (i % 4 == 0) {
+                *word = expected[page_number] = ++value;
+            } else if (*word != expected[page_number]) {
+                corrupted++;
+            }
+        }
+        double elapsed = now_seconds() - start;
+        if (write(live_pager.stop_pipe[1], "", 1) == -1) {
+            perror("live: Error stopping handler thread");
+        }
+        pthread_join(live_pager.thread, NULL);
+
+        unsigned char *residency = malloc(pages);
+        long resident = 0;
+        if (residency != NULL && mincore(region, (size_t)pages * PAGE_SIZE, residency) == 0) {
+            for (int page_number = 0; page_number < pages; page_number++) {
+                resident += residency[page_number] & 1;
+            }
+        }
+        free(residency);
+
+        lock_pager();
+        printf("Live pager: %d pages (%ld KB) %s, %d passes, policy %s, %d frames\n", pages, (long)pages * PAGE_SIZE / 1024,
+               random_order ? "in random order" : "in order", passes, current_policy->name, num_frames);
+        printf("  Accesses:     %ld in %.3f s (%.0f/s), %ld corrupted\n", accesses, elapsed, elapsed > 0 ? accesses / elapsed : 0, corrupted);
+        printf("  Real faults:  %ld, %ld of them pager faults\n", live_pager.real_faults, current_policy->faults - pager_faults);
+        printf("  Evictions:    %ld, %ld of them dirty\n", live_pager.evictions, live_pager.dirty_evictions);
+        printf("  Resident:     %d pages at most, %ld at the end\n", live_pager.peak_resident, resident);
+        print_latency_summary("Fault service", &live_pager.latency);
+        unlock_pager();
+    }
+
+    lock_pager();
+    release_process_memory(page_tables, LIVE_PROCESS_ID);
+    unmap_process_image(LIVE_PROCESS_ID);
+    pager_trace_level = trace_level;
+    live_pager.region = NULL;
+    unlock_pager();
+    close(live_pager.stop_pipe[0]);
+    close(live_pager.stop_pipe[1]);
+    close(live_pager.uffd);
+    live_pager.uffd = -1;
+    munmap(region, (size_t)pages * PAGE_SIZE);
+    free(live_pager.mapped);
+    free(expected);
+}
+
+// Structure representing a memory-access trace loaded from a file
+typedef struct {
+    int *process_ids;
+    int *page_numbers;
+    char *is_write;
+    uint64_t *keys;  // Page key of every access
+    long length;
+    long capacity;
+} Trace;
+
+// Function to free a trace
+void free_trace(Trace *trace) {
+    free(trace->process_ids);
+    free(trace->page_numbers);
+    free(trace->is_write);
+    free(trace->keys);
+    memset(trace, 0, sizeof(*trace));
+}
+
+// Function to append an access to a trace
+int trace_append(Trace *trace, int process_id, int page_number, int is_write) {
+    if (trace->length == trace->capacity) {
+        long capacity = trace->capacity ? trace->capacity * 2 : 4096;
+        int *process_ids = realloc(trace->process_ids, capacity * sizeof(int));
+        if (process_ids != NULL) trace->process_ids = process_ids;
+        int *page_numbers = realloc(trace->page_numbers, capacity * sizeof(int));
+        if (page_numbers != NULL) trace->page_numbers = page_numbers;
+        char *writes = realloc(trace->is_write, capacity);
+        if (writes != NULL) trace->is_write = writes;
+        uint64_t *keys = realloc(trace->keys, capacity * sizeof(uint64_t));
+        if (keys != NULL) trace->keys = keys;
+        if (process_ids == NULL || page_numbers == NULL || writes == NULL || keys == NULL) {
+            perror("Error allocating trace");
+            return -1;
+        }
+        trace->capacity = capacity;
+    }
+    trace->process_ids[trace->length] = process_id;
+    trace->page_numbers[trace->length] = page_number;
+    trace->is_write[trace->length] = (char)is_write;
+    trace->keys[trace->length] = PAGE_KEY(process_id, page_number);
+    trace->length++;
+    return 0;
+}
+
+// Function to load a trace file with one "pid vaddr R|W" access per line.
+// Blank lines and lines starting with '#' are ignored.
+int load_trace(const char *filename, Trace *trace) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        perror("Error opening trace file");
+        return -1;
+    }
+
+    char line[256];
+    long line_number = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+        int process_id;
+        unsigned long long vaddr;
+        char access[8];
+        char *start = line + strspn(line, " \t");
+        if (*start == '#' || *start == '\n' || *start == '\0') {
+            continue;
+        }
+        if (sscanf(start, "%d %lli %7s", &process_id, &vaddr, access) != 3 ||
+            (access[0] != 'R' && access[0] != 'r' && access[0] != 'W' && access[0] != 'w')) {
+            fprintf(stderr, "%s:%ld: expected \"pid vaddr R|W\"\n", filename, line_number);
+            continue;
+        }
+        if (process_id < 0 || process_id >= MAX_PROCESSES || vaddr >= VIRTUAL_MEMORY_SIZE) {
+            fprintf(stderr, "%s:%ld: process ID or address out of range\n", filename, line_number);
+            continue;
+        }
+        if (trace_append(trace, process_id, (int)(vaddr / PAGE_SIZE), access[0] == 'W' || access[0] == 'w') != 0) {
+            fclose(file);
+            return -1;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+// Function to compute the LRU stack distance of every access in one pass
+// (Mattson's algorithm). hist[d] counts accesses at distance d, so a memory
+// of c frames misses on the cold accesses plus every access with d > c.
+// A Fenwick tree over trace positions marks each page's latest access, making
+// the distance the number of marks after the page's previous access.
+long *compute_stack_distances(const Trace *trace, long *cold_misses, long *distinct_pages) {
+    long n = trace->length;
+    long *hist = calloc(n + 2, sizeof(long));
+    int *tree = calloc(n + 1, sizeof(int));
+    PageMap last_access;
+    if (hist == NULL || tree == NULL || page_map_init(&last_access, 1024) != 0) {
+        perror("Error allocating stack distance tables");
+        free(hist);
+        free(tree);
+        return NULL;
+    }
+
+    *cold_misses = 0;
+    for (long i = 0; i < n; i++) {
+        long *last = page_map_insert(&last_access, trace->keys[i]);
+        if (*last == 0) {
+            (*cold_misses)++;
+        } else {
+            long previous = *last;  // 1-based position of the previous access
+            long marked_through_previous = 0;
+            long marked_total = 0;
+            for (long j = previous; j > 0; j -= j & -j) marked_through_previous += tree[j];
+            for (long j = i; j > 0; j -= j & -j) marked_total += tree[j];
+            hist[marked_total - marked_through_previous + 1]++;
+            for (long j = previous; j <= n; j += j & -j) tree[j]--;
+        }
+        for (long j = i + 1; j <= n; j += j & -j) tree[j]++;
+        *last = i + 1;
+    }
+    *distinct_pages = (long)last_access.count;
+
+    page_map_free(&last_access);
+    free(tree);
+    return hist;
+}
+
+// Function to print the LRU miss-ratio curve and optionally write every point to a CSV file
+void report_miss_ratio_curve(const Trace *trace, const char *curve_filename) {
+    long cold_misses, distinct_pages;
+    long *hist = compute_stack_distances(trace, &cold_misses, &distinct_pages);
+    if (hist == NULL) {
+        return;
+    }
+
+    FILE *curve = NULL;
+    if (curve_filename != NULL && (curve = fopen(curve_filename, "w")) == NULL) {
+        perror("Error opening curve file");
+    }
+    if (curve != NULL) {
+        fprintf(curve, "frames,faults,fault_rate\n");
+    }
+
+    printf("LRU miss-ratio curve (%ld distinct pages, %ld cold misses):\n", distinct_pages, cold_misses);
+    printf("  %10s %12s %10s\n", "Frames", "Faults", "Fault rate");
+    long faults = trace->length;  // With zero frames every access faults
+    long next_report = 1;
+    for (long frames = 1; frames <= distinct_pages; frames++) {
+        faults -= hist[frames];
+        double rate = (double)faults / trace->length;
+        if (curve != NULL) {
+            fprintf(curve, "%ld,%ld,%.6f\n", frames, faults, rate);
+        }
+        if (frames == next_report || frames == distinct_pages || frames == num_frames) {
+            printf("%c %10ld %12ld %9.2f%%\n", frames == num_frames ? '*' : ' ', frames, faults, 100.0 * rate);
+        }
+        if (frames == next_report) {
+            next_report *= 2;
+        }
+    }
+    if (distinct_pages > num_frames) {
+        printf("  (* marks the configured %d frames)\n", num_frames);
+    }
+
+    if (curve != NULL) {
+        fclose(curve);
+        printf("Wrote %ld points to %s\n", distinct_pages, curve_filename);
+    }
+    free(hist);
+}
+
+// Function to set up page tables for the processes that only exist in a
+// trace, marking them in created. Each is charged for the distinct pages it
+// writes; a page it only reads stays clean, so it can always be dropped and
+// filled again, like a page of a read-only mapping. If the overcommit mode
+// refuses a process, the ones already set up are torn down and -1 is
+// returned. The caller must hold pager_lock.
+int create_trace_processes(const Trace *trace, int *created, const char *command) {
+    int present[MAX_PROCESSES] = {0};
+    long written[MAX_PROCESSES] = {0};
+    PageMap seen = {0};
+    if (page_map_init(&seen, 1024) != 0) {
+        page_map_free(&seen);
+        return -1;
+    }
+    for (long i = 0; i < trace->length; i++) {
+        present[trace->process_ids[i]] = 1;
+        if (trace->is_write[i]) {
+            size_t before = seen.count;
+            page_map_insert(&seen, trace->keys[i]);
+            written[trace->process_ids[i]] += seen.count != before;
+        }
+    }
+    page_map_free(&seen);
+
+    for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+        if (!present[process_id] || page_tables[process_id].num_entries != 0) {
+            continue;
+        }
+        if (commit_pages(process_id, written[process_id]) != 0) {
+            fprintf(stderr, "%s: cannot commit %ld written pages for process %d under overcommit mode %s\n", command,
+                    written[process_id], process_id, overcommit_mode_names[overcommit.mode]);
+            for (int id = 0; id < process_id; id++) {
+                if (created[id]) {
+                    terminate_process(page_tables, id);
+                    created[id] = 0;
+                }
+            }
+            return -1;
+        }
+        init_page_table(&page_tables[process_id], VIRTUAL_PAGES);
+        map_process_image(process_id);
+        created[process_id] = 1;
+    }
+    return 0;
+}
+
+// Function to run one access of a trace through the pager, checking that a
+// page written earlier still holds what was last written to it. The caller
+// must hold pager_lock.
+void simulate_access(const Trace *trace, long i, PageMap *stamps, long *corrupted) {
+    PageTable *pt = &page_tables[trace->process_ids[i]];
+    long *stamp = page_map_find(stamps, trace->keys[i]);
+    if (pager_access(trace->process_ids[i], (uint64_t)trace->page_numbers[i] * PAGE_SIZE, trace->is_write[i]) == -1) {
+        return;  // The OOM killer terminated the process
+    }
+    char *data = frame_data(pt_lookup(pt, trace->page_numbers[i])->frame_number);
+    if (stamp != NULL && memcmp(data, stamp, sizeof(long)) != 0) {
+        (*corrupted)++;
+    }
+    if (trace->is_write[i]) {
+        if (stamp == NULL) {
+            stamp = page_map_insert(stamps, trace->keys[i]);
+        }
+        *stamp = i;
+        memcpy(data, &i, sizeof(long));
+    }
+}
+
+// Function to run the accesses held back while their processes were
+// suspended, for the processes that have been resumed. An access stays held
+// behind an earlier one of its process, so each process keeps its order.
+// Returns the number of accesses still held. The caller must hold pager_lock.
+long replay_held_accesses(const Trace *trace, long *held, long count, long *pending, PageMap *stamps, long *corrupted) {
+    char blocked[MAX_PROCESSES] = {0};
+    long kept = 0;
+    for (long j = 0; j < count; j++) {
+        int process_id = trace->process_ids[held[j]];
+        if (working_sets[process_id].suspended || blocked[process_id]) {
+            blocked[process_id] = 1;
+            held[kept++] = held[j];
+        } else {
+            pending[process_id]--;
+            simulate_access(trace, held[j], stamps, corrupted);
+        }
+    }
+    return kept;
+}
+
+// Function to run a memory-access trace through the pager with the current
+// replacement policy, then report the LRU miss-ratio curve for every memory size.
+// Accesses of a process suspended by load control are held back until it is resumed.
+void simulate_trace(const char *filename, const char *curve_filename) {
+    Trace trace = {0};
+    if (load_trace(filename, &trace) != 0) {
+        free_trace(&trace);
+        return;
+    }
+    if (trace.length == 0) {
+        fprintf(stderr, "simulate: %s contains no accesses\n", filename);
+        free_trace(&trace);
+        return;
+    }
+
+    // Set up page tables for processes that only exist in the trace
+    lock_pager();
+    int created[MAX_PROCESSES] = {0};
+    if (create_trace_processes(&trace, created, "simulate") != 0) {
+        unlock_pager();
+        free_trace(&trace);
+        return;
+    }
+
+    ReplacementPolicy *policy = current_policy;
+    long hits_before = policy->hits;
+    long faults_before = policy->faults;
+    long evictions_before = policy->evictions;
+    int trace_level = pager_trace_level;
+
+    // Every write stamps its page with the access index; later accesses check
+    // the stamp survived eviction and swap-in
+    PageMap stamps = {0};
+    long corrupted = 0;
+    long *held = malloc(trace.length * sizeof(long));
+    if (page_map_init(&stamps, 1024) != 0 || held == NULL) {
+        if (held == NULL) {
+            perror("Error allocating held accesses");
+        }
+        unlock_pager();
+        page_map_free(&stamps);
+        free(held);
+        free_trace(&trace);
+        return;
+    }
+    long held_count = 0;
+    long held_total = 0;
+    long pending[MAX_PROCESSES] = {0};  // Held accesses of each process
+    long suspensions_before = load_control.suspensions;
+    long kills_before = oom_killer.kills;
+    long references_before[MAX_PROCESSES];
+    long process_faults_before[MAX_PROCESSES];
+    for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+        references_before[process_id] = working_sets[process_id].virtual_time;
+        process_faults_before[process_id] = working_sets[process_id].faults;
+    }
+    long resumptions = load_control.resumptions;
+
+    set_reference_string(trace.keys, trace.length);  // Lets OPT see the future
+    pager_trace_level = TRACE_OFF;
+    unlock_pager();
+    double start = now_seconds();
+    for (long i = 0; i < trace.length; i++) {
+        // Take the lock per access so the cleaner can run alongside
+        lock_pager();
+        int process_id = trace.process_ids[i];
+        if (working_sets[process_id].suspended || pending[process_id] > 0) {
+            held[held_count++] = i;
+            pending[process_id]++;
+            held_total++;
+        } else {
+            simulate_access(&trace, i, &stamps, &corrupted);
+        }
+        while (load_control.resumptions != resumptions) {
+            resumptions = load_control.resumptions;
+            held_count = replay_held_accesses(&trace, held, held_count, pending, &stamps, &corrupted);
+        }
+        unlock_pager();
+    }
+
+    // The trace is over, so let every suspended process finish
+    lock_pager();
+    while (1) {
+        for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+            if (working_sets[process_id].suspended) {
+                resume_process(process_id);
+            }
+        }
+        if (held_count == 0) {
+            break;
+        }
+        held_count = replay_held_accesses(&trace, held, held_count, pending, &stamps, &corrupted);
+    }
+    double elapsed = now_seconds() - start;
+    pager_trace_level = trace_level;
+    set_reference_string(NULL, 0);
+
+    long hits = policy->hits - hits_before;
+    long faults = policy->faults - faults_before;
+    printf("Simulated %ld accesses from %s with policy %s in %.3f s\n", trace.length, filename, policy->name, elapsed);
+    printf("  Hits: %ld  Faults: %ld  Evictions: %ld  Fault rate: %.2f%%\n", hits, faults,
+           policy->evictions - evictions_before, 100.0 * faults / trace.length);
+    for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+        long references = working_sets[process_id].virtual_time - references_before[process_id];
+        if (references > 0 && references < trace.length) {
+            long process_faults = working_sets[process_id].faults - process_faults_before[process_id];
+            printf("  Process %d: %ld accesses, %ld faults, fault rate %.2f%%\n", process_id, references, process_faults,
+                   100.0 * process_faults / references);
+        }
+    }
+    if (load_control.suspensions > suspensions_before) {
+        printf("  Load control: %ld suspensions, %ld accesses held back\n", load_control.suspensions - suspensions_before,
+               held_total);
+    }
+    if (corrupted > 0) {
+        printf("  Data check: %ld accesses found a written page with the wrong contents\n", corrupted);
+    }
+    if (oom_killer.kills > kills_before) {
+        printf("  OOM killer: %ld killed, their later accesses skipped\n", oom_killer.kills - kills_before);
+    }
+    page_map_free(&stamps);
+    free(held);
+    report_miss_ratio_curve(&trace, curve_filename);
+
+    // Tear down the processes the trace created
+    for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+        if (created[process_id] && page_tables[process_id].num_entries != 0) {
+            terminate_process(page_tables, process_id);  // Unless the OOM killer already did
+        }
+    }
+    unlock_pager();
+    free_trace(&trace);
+}
+
+// Function to drive a trace through pager_access_batch() as fast as the
+// pager allows, repeating it the given number of times. Unlike simulate it
+// does not check page contents, hold back suspended processes or compute the
+// miss-ratio curve, so it measures the access path itself.
+void replay_trace(const char *filename, int repeat) {
+    Trace trace = {0};
+    if (load_trace(filename, &trace) != 0 || trace.length == 0) {
+        if (trace.length == 0) {
+            fprintf(stderr, "replay: %s contains no accesses\n", filename);
+        }
+        free_trace(&trace);
+        return;
+    }
+    PageAccess *accesses = malloc(trace.length * sizeof(PageAccess));
+    if (accesses == NULL) {
+        perror("Error allocating accesses");
+        free_trace(&trace);
+        return;
+    }
+    for (long i = 0; i < trace.length; i++) {
+        accesses[i].process_id = trace.process_ids[i];
+        accesses[i].is_write = trace.is_write[i];
+        accesses[i].vaddr = (uint64_t)trace.page_numbers[i] * PAGE_SIZE;
+    }
+
+    lock_pager();
+    int created[MAX_PROCESSES] = {0};
+    if (create_trace_processes(&trace, created, "replay") != 0) {
+        unlock_pager();
+        free(accesses);
+        free_trace(&trace);
+        return;
+    }
+    ReplacementPolicy *policy = current_policy;
+    long hits_before = policy->hits;
+    long evictions_before = policy->evictions;
+    long dirty_before = dirty_evictions;
+    long kills_before = oom_killer.kills;
+    int trace_level = pager_trace_level;
+    pager_trace_level = TRACE_OFF;
+    set_reference_string(trace.keys, trace.length);
+    unlock_pager();
+
+    long faults = 0;
+    long total = trace.length * repeat;
+    double start = now_seconds();
+    for (int pass = 0; pass < repeat; pass++) {
+        if (pass > 0) {
+            lock_pager();
+            opt_start = policy_clock;  // OPT looks ahead from the start of the trace again
+            unlock_pager();
+        }
+        for (long i = 0; i < trace.length; i += ACCESS_BATCH_SIZE) {
+            long count = trace.length - i < ACCESS_BATCH_SIZE ? trace.length - i : ACCESS_BATCH_SIZE;
+            faults += pager_access_batch(accesses + i, count);
+        }
+    }
+    double elapsed = now_seconds() - start;
+
+    lock_pager();
+    pager_trace_level = trace_level;
+    set_reference_string(NULL, 0);
+    printf("Replayed %ld accesses from %s with policy %s in %.3f s (%.2f million/s)\n", total, filename, policy->name, elapsed,
+           elapsed > 0 ? total / elapsed / 1e6 : 0.0);
+    printf("  Hits: %ld  Faults: %ld  Evictions: %ld (%ld dirty)  Fault rate: %.2f%%\n", policy->hits - hits_before, faults,
+           policy->evictions - evictions_before, dirty_evictions - dirty_before, 100.0 * faults / total);
+    if (oom_killer.kills > kills_before) {
+        printf("  OOM killer: %ld killed, their later accesses skipped\n", oom_killer.kills - kills_before);
+    }
+    for (int process_id = 0; process_id < MAX_PROCESSES; process_id++) {
+        if (created[process_id] && page_tables[process_id].num_entries != 0) {
+            terminate_process(page_tables, process_id);  // Unless the OOM killer already did
+        }
+    }
+    unlock_pager();
+    free(accesses);
+    free_trace(&trace);
+}
+
+// Function to release the mapped executable image of a process
+void unmap_process_image(int process_id) {
+    ProcessResources *resources = &process_resources[process_id];
+    if (resources->executable_image != NULL) {
+        release_mapped_file(resources->executable_file);
+    }
+    resources->executable_mapped = 0;
+    resources->executable_image = NULL;
+    resources->executable_size = 0;
+}
+
+// Function to clean up resources for a process
+void cleanup_process_resources(int process_id) {
+    ProcessResources *resources = &process_resources[process_id];
+
+    // Free the memory blocks and the buffer of frames holding them
+    for (int i = 0; i < resources->num_allocated_blocks; i++) {
+        resources->allocated_memory[i] = NULL;
+    }
+    if (resources->num_allocated_blocks > 0) {
+        buddy_free(resources->buffer_frame, resources->buffer_order);
+        buddy.shell_frames -= 1 << resources->buffer_order;
+    }
+    free(resources->allocated_memory);
+    resources->allocated_memory = NULL;
+
+    // Close open file descriptors
+    for (int i = 0; i < resources->num_open_files; i++) {
+        if (resources->open_files[i] != -1) {
+            close(resources->open_files[i]);
+            resources->open_files[i] = -1;
+        }
+    }
+
+    unmap_process_image(process_id);
+    for (int i = 0; i < resources->num_regions; i++) {
+        release_mapped_file(resources->regions[i].file);
+    }
+    resources->num_regions = 0;
+
+    // Reset the resource counts
+    resources->num_allocated_blocks = 0;
+    resources->num_open_files = 0;
+
+    printf("Cleaned up resources for process %d\n", process_id);
+}
+
+// Function to release the memory of a process: its frames, swap slots,
+// compressed copies, page table and TLB entries
+void release_process_memory(PageTable *pt, int process_id) {
+    // Free the frames, swap slots and compressed copies of the process, visiting only the allocated leaves
+    PageTable *process_pt = &pt[process_id];
+    for (int dir = 0; process_pt->directory != NULL && dir < pt_directory_size(process_pt); dir++) {
+        for (int i = 0; process_pt->directory[dir] != NULL && i < PT_LEAF_SIZE; i++) {
+            PageTableEntry *entry = &process_pt->directory[dir]->entries[i];
+            if (entry->valid) {
+                wait_for_writeback(entry->frame_number);  // Its swap slot must not be reused mid-write
+                release_frame_mapping(entry->frame_number, process_id, dir * PT_LEAF_SIZE + i);
+            }
+            if (entry->swap_slot != -1) {
+                free_swap_slot(entry->swap_slot);
+            }
+            if (entry->zswap_entry != -1) {
+                zswap_drop(entry);
+            }
+        }
+    }
+
+    free_page_table(pt, process_id);
+    tlb_flush_asid(process_id);
+    readahead_state[process_id].window = 0;  // Keep the counters, forget the stream
+    readahead_state[process_id].run = 0;
+    load_control.suspended_processes -= working_sets[process_id].suspended;
+    memset(&working_sets[process_id], 0, sizeof(WorkingSet));
+    uncommit_process(process_id);
+    oom_killer.score_adj[process_id] = 0;
+}
+
+// Function to terminate a process
+void terminate_process(PageTable *pt, int process_id) {
+    release_process_memory(pt, process_id);
+    cleanup_process_resources(process_id);
+}
+
+// Function to clone a process. The clone gets a page table of its own, but
+// every resident page shares its frame copy-on-write and every swapped-out
+// page shares its swap slot; compressed copies are duplicated, being small.
+void clone_process(int source_id, int clone_id) {
+    long start = now_nanoseconds();
+    PageTable *source = &page_tables[source_id];
+    PageTable *clone = &page_tables[clone_id];
+    init_page_table(clone, source->num_entries);
+    map_executable_image(clone_id, source_id);
+    ProcessResources *resources = &process_resources[clone_id];
+    memcpy(resources->regions, process_resources[source_id].regions, sizeof(resources->regions));
+    resources->num_regions = process_resources[source_id].num_regions;
+    for (int i = 0; i < resources->num_regions; i++) {
+        mapped_files[resources->regions[i].file].users++;
+    }
+
+    int shared = 0;
+    int swapped = 0;
+    for (int dir = 0; source->directory != NULL && dir < pt_directory_size(source); dir++) {
+        for (int i = 0; source->directory[dir] != NULL && i < PT_LEAF_SIZE; i++) {
+            PageTableEntry *entry = &source->directory[dir]->entries[i];
+            if (!pte_in_use(entry)) {
+                continue;
+            }
+            int page_number = dir * PT_LEAF_SIZE + i;
+            PageTableEntry *copy = pt_lookup_create(clone, page_number);
+            clone->directory[dir]->live_entries++;
+            copy->valid = entry->valid;
+            copy->frame_number = entry->frame_number;
+            copy->modified = entry->modified;  // Sharers of a frame agree on whether it is dirty
+            if (entry->valid) {
+                rmap_add(entry->frame_number, clone_id, page_number);
+                clone->directory[dir]->resident_entries++;
+                clone->resident_pages++;
+                shared++;
+            }
+            if (entry->swap_slot != -1) {
+                copy->swap_slot = entry->swap_slot;
+                swap_count[entry->swap_slot]++;
+                swapped += !entry->valid;
+            }
+            if (entry->zswap_entry != -1) {
+                ZswapEntry *compressed = &zswap.entries[entry->zswap_entry];
+                zswap_insert(clone_id, page_number, compressed->data, compressed->size);
+                swapped += !entry->valid && entry->swap_slot == -1;
+            }
+        }
+    }
+    zswap_shrink(-1);
+
+    // Huge pages stay huge in the clone, sharing the same 2 MB block
+    for (int dir = 0; source->directory != NULL && dir < pt_directory_size(source); dir++) {
+        if (source->directory[dir] != NULL && source->directory[dir]->huge_frame != -1) {
+            clone->directory[dir]->huge_frame = source->directory[dir]->huge_frame;
+            huge_pages.mapped++;
+        }
+    }
+
+    printf("Cloned process %d into process %d in %.1f us: %d resident pages shared copy-on-write, %d swapped-out pages\n",
+           source_id, clone_id, (now_nanoseconds() - start) / 1000.0, shared, swapped);
+}
+
+// Function to free the page table for a process
+void free_page_table(PageTable *pt, int process_id) {
+    PageTable *process_pt = &pt[process_id];
+    if (process_pt->directory != NULL) {
+        for (int dir = 0; dir < pt_directory_size(process_pt); dir++) {
+            if (process_pt->directory[dir] != NULL) {
+                huge_pages.mapped -= process_pt->directory[dir]->huge_frame != -1;
+                free(process_pt->directory[dir]);
+                page_table_bytes -= sizeof(PageTableLeaf);
+            }
+        }
+        free(process_pt->directory);
+        page_table_bytes -= pt_directory_size(process_pt) * sizeof(PageTableLeaf *);
+    }
+    process_pt->directory = NULL;
+    process_pt->num_leaves = 0;
+    process_pt->resident_pages = 0;
+    process_pt->num_entries = 0;
+}
+
+// Function to allocate resources for a process
+void allocate_resources_for_process(int process_id) {
+    ProcessResources *resources = &process_resources[process_id];
+
+    // Simulate allocating memory blocks, carved out of one contiguous buffer of frames
+    resources->allocated_memory = malloc(10 * sizeof(void *));  // Allocate array for 10 blocks
+    resources->buffer_order = buddy_order_for(calculate_pages_needed(10 * 1024));
+    lock_pager();
+    resources->buffer_frame = buddy_allocate(resources->buffer_order);
+    if (resources->buffer_frame != -1) {
+        buddy.shell_frames += 1 << resources->buffer_order;
+    }
+    unlock_pager();
+    if (resources->buffer_frame == -1) {
+        fprintf(stderr, "Error allocating memory blocks for process %d: no free frames\n", process_id);
+    } else {
+        resources->num_allocated_blocks = 10;
+        for (int i = 0; i < 10; i++) {
+            resources->allocated_memory[i] = frame_data(resources->buffer_frame) + i * 1024;  // 1 KB blocks
+        }
+    }
+
+    // Simulate opening file descriptors
+    resources->num_open_files = 3;
+    resources->open_files[0] = open("file1.txt", O_RDONLY | O_CREAT, 0644);
+    resources->open_files[1] = open("file2.txt", O_WRONLY | O_CREAT, 0644);
+    resources->open_files[2] = open("file3.txt", O_RDWR | O_CREAT, 0644);
+
+    map_process_image(process_id);  // Map the executable image once, up front
+}
+
+// Function to set the PATH environment variable
+void set_path_environment() {
+    setenv("PATH", "/bin:/usr/bin:/usr/local/bin", 1);
+}
+
+int main(int argc, char *argv[]) {
+    // Set up signal handlers
+    signal(SIGINT, handle_signal);
+    signal(SIGQUIT, handle_signal);
+
+    set_path_environment();  // Set the PATH environment variable
+
+    // Parse command line options
+    const char *policy_name = NULL;
+    int use_huge_pages = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:Hm:")) != -1) {
+        if (opt == 'p') {
+            policy_name = optarg;
+        } else if (opt == 'H') {
+            use_huge_pages = 1;
+        } else if (opt == 'm') {
+            int megabytes = atoi(optarg);
+            if (megabytes < 4 || megabytes > MAX_MEMORY_MB) {
+                fprintf(stderr, "Physical memory must be between 4 and %d MB\n", MAX_MEMORY_MB);
+                return 1;
+            }
+            num_frames = megabytes * (1024 / (PAGE_SIZE / 1024));
+        } else {
+            fprintf(stderr, "Usage: %s [-p policy] [-H] [-m megabytes] [batch_file]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    init_physical_memory(use_huge_pages);  // Map the memory that backs the frames
+    init_frame_table();  // Initialize the frame table
+    init_policy_state();
+    for (int id = 0; id < MAX_PROCESSES; id++) {
+        pthread_mutex_init(&page_tables[id].lock, NULL);
+    }
+    if (policy_name != NULL && set_replacement_policy(policy_name) != 0) {
+        fprintf(stderr, "Unknown replacement policy '%s'\n", policy_name);
+        return 1;
+    }
+
+    if (optind < argc) {
+        batch_mode(argv[optind]);  // Run in batch mode if a filename is provided
+    } else {
+        start_cleaner();  // Write dirty pages back in the background
+        char input[MAX_INPUT_SIZE];
+        int process_id = 1;
+        int process_memory = 1000000;
+        int num_pages = calculate_pages_needed(process_memory);
+
+        init_page_table(&page_tables[process_id], num_pages);  // Initialize the page table for the process
+        commit_pages(process_id, num_pages);  // Always fits: the commit limit is at least the swap device
+        oom_killer.score_adj[process_id] = OOM_SCORE_ADJ_MIN;  // The shell's own process is never killed
         allocate_resources_for_process(process_id);  // Allocate resources for the process
 
         while (1) {
@@ -429,10 +6522,18 @@ int main(int argc, char *argv[]) {
             if (fgets(input, sizeof(input), stdin) == NULL) {
                 break;
             }
-            execute_commands(input, process_id, &pt[process_id]);  // Execute commands entered by the user
+            execute_commands(input, process_id, &page_tables[process_id]);  // Execute commands entered by the user
         }
 
-        terminate_process(pt, process_id);  // Terminate the process and free resources
+        stop_cleaner();
+        stop_merger();
+        lock_pager();
+        for (int id = 0; id < MAX_PROCESSES; id++) {
+            if (page_tables[id].num_entries != 0) {
+                terminate_process(page_tables, id);  // Terminate the shell's process and any clones
+            }
+        }
+        unlock_pager();
     }
 
     return 0;
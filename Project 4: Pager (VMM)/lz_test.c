@@ -0,0 +1,96 @@
+// Round-trip test for the compressed pool's LZ coder. Build and run with
+//   gcc -pthread -o lz_test lz_test.c && ./lz_test
+// The shell is compiled in with its main renamed, so the test calls the
+// same lz_compress() and lz_decompress() that zswap uses.
+#define main lope_shell_main
+#include "lopeShell.c"
+#undef main
+
+#define LZ_TEST_CAPACITY (PAGE_SIZE + PAGE_SIZE / 255 + 16)  // Worst case: every byte a literal
+
+int failures = 0;
+
+// Function to compress a page, decompress it and compare it with the
+// original. Returns the compressed size, -1 if the round trip failed.
+int round_trip(const char *name, const unsigned char *page) {
+    unsigned char compressed[LZ_TEST_CAPACITY];
+    unsigned char restored[PAGE_SIZE];
+    int size = lz_compress(page, PAGE_SIZE, compressed, sizeof(compressed));
+    if (size < 0) {
+        printf("FAIL %s: does not compress into %d bytes\n", name, LZ_TEST_CAPACITY);
+        failures++;
+        return -1;
+    }
+    memset(restored, 0xa5, sizeof(restored));
+    int restored_size = lz_decompress(compressed, size, restored, sizeof(restored));
+    if (restored_size != PAGE_SIZE || memcmp(page, restored, PAGE_SIZE) != 0) {
+        printf("FAIL %s: decompressed %d bytes that do not match the page\n", name, restored_size);
+        failures++;
+        return -1;
+    }
+    printf("ok   %s: %d bytes compressed to %d\n", name, PAGE_SIZE, size);
+    return size;
+}
+
+// Function to fill a page with bytes from a fixed-seed generator
+void fill_random(unsigned char *page, uint32_t seed) {
+    for (int i = 0; i < PAGE_SIZE; i++) {
+        seed = seed * 1103515245u + 12345u;
+        page[i] = (unsigned char)(seed >> 16);
+    }
+}
+
+int main() {
+    unsigned char page[PAGE_SIZE];
+
+    // An all-zero page is a single run and must fit the pool easily
+    memset(page, 0, sizeof(page));
+    int size = round_trip("all-zero page", page);
+    if (size > 64) {
+        printf("FAIL all-zero page: %d bytes is too large for a single run\n", size);
+        failures++;
+    }
+
+    // An incompressible page must round-trip at full size, and must not fit
+    // the pool's budget, so zswap_store() rejects it
+    fill_random(page, 1);
+    round_trip("incompressible page", page);
+    unsigned char pool_copy[ZSWAP_MAX_COMPRESSED];
+    if (lz_compress(page, PAGE_SIZE, pool_copy, sizeof(pool_copy)) != -1) {
+        printf("FAIL incompressible page: fits in %d bytes\n", ZSWAP_MAX_COMPRESSED);
+        failures++;
+    }
+
+    // A page that is zero except for a stamp in its first word, as simulate writes
+    memset(page, 0, sizeof(page));
+    long stamp = 123456789;
+    memcpy(page, &stamp, sizeof(stamp));
+    round_trip("stamped zero page", page);
+
+    // Repeated text exercises matches at longer offsets
+    for (int i = 0; i < PAGE_SIZE; i++) {
+        page[i] = "the quick brown fox jumps over the lazy dog "[i % 44];
+    }
+    round_trip("repeated text", page);
+
+    // Random and zero stretches alternate, so literals and matches mix
+    fill_random(page, 7);
+    for (int i = 0; i < PAGE_SIZE; i += 512) {
+        memset(page + i, 0, 200 + i / 64);
+    }
+    round_trip("mixed page", page);
+
+    // Runs whose lengths need extra length bytes on both sides of 15 and 270
+    fill_random(page, 42);
+    memset(page + 100, 'x', 15 + LZ_MIN_MATCH);
+    memset(page + 400, 'y', 270 + LZ_MIN_MATCH);
+    memset(page + 1000, 'z', 1000);
+    round_trip("long runs", page);
+
+    if (failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All compressor checks passed\n");
+    return 0;
+}
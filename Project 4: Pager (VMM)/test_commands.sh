@@ -2,3 +2,37 @@
 for i in {1..1000}; do
     echo "Command $i"
 done
+
+# Simulate a write-heavy trace over three times as many pages as the shell
+# has frames, so pages are evicted dirty and read back from the compressed
+# pool or the swap file. Every write stamps its page, and simulate prints a
+# "Data check" line if a later access finds the wrong stamp. Run from the
+# directory lopeShell was built in.
+shell="$(pwd)/lopeShell"
+workdir=$(mktemp -d) || exit 1
+trap 'rm -rf "$workdir"' EXIT
+awk 'BEGIN {
+    for (pass = 0; pass < 3; pass++) {
+        for (page = 0; page < 3000; page++) {
+            printf "2 %d W\n", page * 4096
+            printf "2 %d R\n", (page * 7 % 3000) * 4096
+        }
+    }
+}' > "$workdir/trace.txt"
+
+status=0
+for setup in "policy lru" "policy fifo" "policy clock" "zswap off" "zswap 1" "cleaner off" "readahead off"; do
+    output=$(cd "$workdir" && printf '%s\nsimulate trace.txt\nvmstat\n' "$setup" | "$shell" -m 4 2>&1)
+    writebacks=$(echo "$output" | sed -n 's/^Writebacks: *\([0-9]*\) by the fault handler, \([0-9]*\) by the cleaner.*/\1 + \2/p')
+    writebacks=$((${writebacks:-0}))
+    if echo "$output" | grep -q "Data check"; then
+        echo "FAIL $setup: $(echo "$output" | grep "Data check")"
+        status=1
+    elif [ "$writebacks" -eq 0 ]; then
+        echo "FAIL $setup: the trace did not put the pager under swap pressure"
+        status=1
+    else
+        echo "ok   $setup: stamps survived $writebacks dirty writebacks"
+    fi
+done
+exit $status